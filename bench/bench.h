@@ -0,0 +1,42 @@
+#pragma once
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace bench {
+using clock = std::chrono::steady_clock;
+
+/**
+ * Run `fn` `iterations` times after a short warm-up and print the mean
+ * time per iteration. Returns the mean in nanoseconds.
+ */
+template <typename Fn>
+auto measure(const char* label, std::size_t iterations, Fn&& fn) -> double {
+  constexpr std::size_t warm_up = 16;
+  for (std::size_t i = 0; i < warm_up; ++i) {
+    fn();
+  }
+
+  auto start = clock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    fn();
+  }
+  auto elapsed = std::chrono::duration<double, std::nano>(clock::now() - start);
+
+  double mean = elapsed.count() / static_cast<double>(iterations);
+  fmt::print("{:<40} {:>12.0f} ns/op ({} iterations)\n", label, mean,
+             iterations);
+  return mean;
+}
+
+/**
+ * Keep the compiler from optimizing away a computed value.
+ */
+template <typename T>
+void do_not_optimize(const T& value) {
+  asm volatile("" : : "m"(value) : "memory");
+}
+}
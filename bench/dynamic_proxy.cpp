@@ -0,0 +1,64 @@
+#include <bench.h>
+#include <dbus_interface.h>
+
+#include <offlrofl/dynamic_proxy.h>
+
+#include <fmt/format.h>
+
+#include <cstdlib>
+#include <exception>
+#include <vector>
+
+// Compares calls through the generated proxy with calls through the
+// dynamic proxy. Both call org.freedesktop.DBus.GetNameOwner on the
+// session bus, which is always available and cheap to answer, so the
+// difference between the two is the overhead of the proxy itself.
+auto main(int argc, const char** argv) -> int {
+  try {
+    std::size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 0;
+    if (iterations == 0) {
+      iterations = 10000;
+    }
+
+    bench::measure("dynamic_proxy construction", 100, [] {
+      offlrofl::dynamic_proxy proxy{"org.freedesktop.DBus",
+                                    "/org/freedesktop/DBus",
+                                    "org.freedesktop.DBus"};
+      bench::do_not_optimize(proxy);
+    });
+
+    org_freedesktop_DBus generated;
+    bench::measure("generated GetNameOwner", iterations, [&generated] {
+      auto owner = generated.GetNameOwner("org.freedesktop.DBus");
+      bench::do_not_optimize(owner);
+    });
+
+    offlrofl::dynamic_proxy dynamic{"org.freedesktop.DBus",
+                                    "/org/freedesktop/DBus",
+                                    "org.freedesktop.DBus"};
+    std::vector<offlrofl::dynamic_proxy::argument> args{
+        "org.freedesktop.DBus"};
+
+    bench::measure("dynamic GetNameOwner (by name)", iterations,
+                   [&dynamic, &args] {
+                     auto owner = dynamic.call("GetNameOwner", args);
+                     bench::do_not_optimize(owner);
+                   });
+
+    const auto* method = dynamic.find_method("GetNameOwner");
+    if (method == nullptr) {
+      fmt::print(stderr, "GetNameOwner not found in introspection data\n");
+      return EXIT_FAILURE;
+    }
+    bench::measure("dynamic GetNameOwner (by handle)", iterations,
+                   [&dynamic, &args, method] {
+                     auto owner = dynamic.call(*method, args);
+                     bench::do_not_optimize(owner);
+                   });
+
+    return EXIT_SUCCESS;
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "Unknown error: {}\n", e.what());
+  }
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,134 @@
+#include <bench.h>
+
+#include <fmt/format.h>
+#include <fmt/os.h>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+// Runs the interface generator on synthetic introspection data of
+// growing size and reports its run time and peak memory usage.
+
+extern char** environ;
+
+namespace {
+constexpr std::size_t methods_per_interface = 100;
+
+/**
+ * Write introspection data with the given number of methods, split
+ * into interfaces of methods_per_interface methods each. Every tenth
+ * method has an unsupported argument type and is skipped by the
+ * generator.
+ */
+void write_synthetic_xml(const std::filesystem::path& file,
+                         std::size_t methods) {
+  auto out = fmt::output_file(file.string());
+  out.print("<node name=\"/org/example/Synthetic\">\n");
+  for (std::size_t i = 0; i < methods; ++i) {
+    if (i % methods_per_interface == 0) {
+      if (i != 0) {
+        out.print("  </interface>\n");
+      }
+      out.print("  <interface name=\"org.example.Synthetic{}\">\n",
+                i / methods_per_interface);
+    }
+    out.print("    <method name=\"Method{}\">\n", i);
+    out.print("      <arg name=\"name\" type=\"s\" direction=\"in\"/>\n");
+    out.print("      <arg name=\"flags\" type=\"{}\" direction=\"in\"/>\n",
+              i % 10 == 0 ? "as" : "u");
+    out.print("      <arg name=\"result\" type=\"b\" direction=\"out\"/>\n");
+    out.print("    </method>\n");
+  }
+  if (methods != 0) {
+    out.print("  </interface>\n");
+  }
+  out.print("</node>\n");
+}
+
+struct run_result {
+  double seconds;
+  long peak_rss_kib;
+};
+
+/**
+ * Run the generator as a child process and wait for it to finish.
+ */
+auto run_generator(const std::filesystem::path& xml,
+                   const std::filesystem::path& output) -> run_result {
+  std::string xml_arg = xml.string();
+  std::string output_arg = output.string();
+  std::array<char*, 7> args{const_cast<char*>(OFFLROFL_GENERATE_INTERFACE),
+                            const_cast<char*>("--xml"),
+                            xml_arg.data(),
+                            const_cast<char*>("-o"),
+                            output_arg.data(),
+                            const_cast<char*>("org.example.Synthetic"),
+                            nullptr};
+
+  // The generator reports every interface on stderr.
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+  auto start = bench::clock::now();
+  pid_t pid = 0;
+  int res = posix_spawn(&pid, OFFLROFL_GENERATE_INTERFACE, &actions, nullptr,
+                        args.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (res != 0) {
+    throw std::runtime_error("cannot start generator");
+  }
+
+  int status = 0;
+  rusage usage{};
+  wait4(pid, &status, 0, &usage);
+  auto elapsed =
+      std::chrono::duration<double>(bench::clock::now() - start).count();
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    throw std::runtime_error("generator failed");
+  }
+
+  return {elapsed, usage.ru_maxrss};
+}
+}
+
+auto main() -> int {
+  try {
+    auto dir = std::filesystem::temp_directory_path() / "offlrofl-bench";
+    std::filesystem::create_directories(dir);
+
+    fmt::print("{:>8} {:>10} {:>10} {:>12} {:>10}\n", "methods", "time",
+               "peak rss", "output", "unchanged");
+    for (std::size_t methods : {1000, 10000, 50000, 100000}) {
+      auto xml = dir / fmt::format("synthetic-{}.xml", methods);
+      auto output = dir / fmt::format("synthetic-{}.h", methods);
+      write_synthetic_xml(xml, methods);
+      std::filesystem::remove(output);
+
+      auto first = run_generator(xml, output);
+      // The second run produces the same code and leaves the output
+      // untouched.
+      auto second = run_generator(xml, output);
+
+      fmt::print("{:>8} {:>8.3f} s {:>6} MiB {:>8} KiB {:>8.3f} s\n", methods,
+                 first.seconds, first.peak_rss_kib / 1024,
+                 std::filesystem::file_size(output) / 1024, second.seconds);
+    }
+
+    std::filesystem::remove_all(dir);
+    return EXIT_SUCCESS;
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "Unknown error: {}\n", e.what());
+  }
+  return EXIT_FAILURE;
+}
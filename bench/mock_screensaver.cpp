@@ -0,0 +1,88 @@
+#include <mock_screensaver.h>
+
+#include <offlrofl/error.h>
+#include <offlrofl/message.h>
+
+#include <stdexcept>
+
+extern "C" {
+#include <dbus/dbus.h>
+}
+
+namespace {
+constexpr auto service = "org.freedesktop.ScreenSaver";
+constexpr auto iface = "org.freedesktop.ScreenSaver";
+constexpr int poll_timeout_ms = 10;
+}
+
+mock_screensaver::mock_screensaver() {
+  offlrofl::error err;
+  conn = dbus_bus_get_private(DBUS_BUS_SESSION, err);
+  err.throw_if_error();
+
+  int res =
+      dbus_bus_request_name(conn, service, DBUS_NAME_FLAG_DO_NOT_QUEUE, err);
+  if (err.is_error() || res != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+    throw std::runtime_error(
+        "cannot acquire org.freedesktop.ScreenSaver, run the benchmark "
+        "under dbus-run-session");
+  }
+
+  worker = std::thread{[this] { run(); }};
+}
+
+mock_screensaver::~mock_screensaver() {
+  stop.store(true);
+  worker.join();
+  dbus_connection_close(conn);
+  dbus_connection_unref(conn);
+}
+
+void mock_screensaver::run() {
+  uint32_t next_cookie = 1;
+
+  while (!stop.load() && dbus_connection_read_write(conn, poll_timeout_ms)) {
+    while (auto* raw = dbus_connection_pop_message(conn)) {
+      auto msg = offlrofl::message::wrap(raw);
+      if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_METHOD_CALL) {
+        continue;
+      }
+
+      bool inhibit = dbus_message_is_method_call(msg, iface, "Inhibit") != 0;
+      bool uninhibit =
+          dbus_message_is_method_call(msg, iface, "UnInhibit") != 0;
+      if (!inhibit && !uninhibit) {
+        // Fail other calls right away instead of letting the caller run
+        // into the default timeout.
+        auto reply = offlrofl::message::wrap(dbus_message_new_error(
+            msg, DBUS_ERROR_UNKNOWN_METHOD, "method not mocked"));
+        dbus_connection_send(conn, reply, nullptr);
+        dbus_connection_flush(conn);
+        continue;
+      }
+
+      in_call.store(true);
+      auto delay = reply_delay.load(std::memory_order_relaxed);
+      if (delay > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds{delay});
+      }
+
+      auto reply = offlrofl::message::wrap(dbus_message_new_method_return(msg));
+      if (inhibit) {
+        DBusMessageIter iter;
+        dbus_message_iter_init_append(reply, &iter);
+        uint32_t cookie = next_cookie++;
+        dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &cookie);
+        inhibits.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        uninhibits.fetch_add(1, std::memory_order_relaxed);
+      }
+      in_call.store(false);
+
+      dbus_connection_send(conn, reply, nullptr);
+      dbus_connection_flush(conn);
+    }
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+struct DBusConnection;
+
+/**
+ * Minimal org.freedesktop.ScreenSaver service answering Inhibit and
+ * UnInhibit on its own session bus connection. Other calls fail with
+ * UnknownMethod. It must be run on a session bus where the name is not
+ * yet taken, e.g. under `dbus-run-session`.
+ */
+class mock_screensaver {
+public:
+  /**
+   * Acquire the service name and start answering calls.
+   * @throws std::runtime_error if the name cannot be acquired.
+   */
+  mock_screensaver();
+
+  mock_screensaver(const mock_screensaver&) = delete;
+  auto operator=(const mock_screensaver&) -> mock_screensaver& = delete;
+  mock_screensaver(mock_screensaver&&) = delete;
+  auto operator=(mock_screensaver&&) -> mock_screensaver& = delete;
+
+  ~mock_screensaver();
+
+  /**
+   * Delay every reply by the given duration to simulate a slow service.
+   */
+  void set_reply_delay(std::chrono::microseconds delay) {
+    reply_delay.store(delay.count(), std::memory_order_relaxed);
+  }
+
+  /**
+   * Reset all call counters.
+   */
+  void reset() {
+    inhibits.store(0, std::memory_order_relaxed);
+    uninhibits.store(0, std::memory_order_relaxed);
+    in_call.store(false, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] auto calls() const -> uint64_t {
+    return inhibits.load(std::memory_order_relaxed) +
+           uninhibits.load(std::memory_order_relaxed);
+  }
+
+  // Counters are updated before the reply is sent, so they are
+  // accurate as soon as the calling side has received its reply.
+  std::atomic<uint64_t> inhibits{0};
+  std::atomic<uint64_t> uninhibits{0};
+
+  // Set while a call is received but not yet answered.
+  std::atomic<bool> in_call{false};
+
+private:
+  void run();
+
+  DBusConnection* conn = nullptr;
+  std::atomic<int64_t> reply_delay{0};
+  std::atomic<bool> stop{false};
+  std::thread worker;
+};
@@ -0,0 +1,158 @@
+#include <mpv_shim.h>
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+auto find_observed(mpv_handle& handle, const char* name)
+    -> const mpv_handle::observed_property* {
+  auto it = std::find_if(
+      handle.observed.begin(), handle.observed.end(),
+      [name](const auto& property) { return property.name == name; });
+  return it != handle.observed.end() ? &*it : nullptr;
+}
+
+/**
+ * Fill the event storage of the handle with the given scripted event.
+ * Returns false if the event would not be delivered by mpv, i.e. it is
+ * a change of a property the client does not observe.
+ */
+auto prepare_event(mpv_handle& handle, const mpv_handle::scripted_event& evt)
+    -> bool {
+  handle.current = mpv_event{};
+  handle.current.event_id = evt.id;
+  if (evt.id != MPV_EVENT_PROPERTY_CHANGE) {
+    return true;
+  }
+
+  const auto* observed = find_observed(handle, evt.property);
+  if (observed == nullptr) {
+    return false;
+  }
+
+  handle.current.reply_userdata = observed->reply_userdata;
+  handle.current.data = &handle.current_property;
+  handle.current_property.name = observed->name.c_str();
+  handle.current_property.format = observed->format;
+  switch (observed->format) {
+  case MPV_FORMAT_FLAG:
+    handle.current_flag = evt.value != 0 ? 1 : 0;
+    handle.current_property.data = &handle.current_flag;
+    break;
+  case MPV_FORMAT_INT64:
+    handle.current_int = evt.value;
+    handle.current_property.data = &handle.current_int;
+    break;
+  default:
+    // Other formats are not scripted, report the property as changed
+    // without a value.
+    handle.current_property.format = MPV_FORMAT_NONE;
+    handle.current_property.data = nullptr;
+    break;
+  }
+  return true;
+}
+}
+
+extern "C" {
+auto mpv_wait_event(mpv_handle* ctx, double /*timeout*/) -> mpv_event* {
+  if (ctx->delivered == 1) {
+    ctx->first_event_handled = std::chrono::steady_clock::now();
+  }
+
+  while (!ctx->shutdown.load(std::memory_order_acquire) &&
+         ctx->next < ctx->script.size()) {
+    if (prepare_event(*ctx, ctx->script[ctx->next++])) {
+      ++ctx->delivered;
+      return &ctx->current;
+    }
+  }
+
+  // mpv keeps returning shutdown events once it is shutting down.
+  ctx->current = mpv_event{};
+  ctx->current.event_id = MPV_EVENT_SHUTDOWN;
+  ++ctx->delivered;
+  return &ctx->current;
+}
+
+auto mpv_observe_property(mpv_handle* mpv,
+                          uint64_t reply_userdata,
+                          const char* name,
+                          mpv_format format) -> int {
+  if (name == nullptr) {
+    return MPV_ERROR_INVALID_PARAMETER;
+  }
+  mpv->observed.push_back({name, reply_userdata, format});
+  return 0;
+}
+
+auto mpv_unobserve_property(mpv_handle* mpv, uint64_t registered_reply_userdata)
+    -> int {
+  auto it = std::remove_if(mpv->observed.begin(), mpv->observed.end(),
+                           [registered_reply_userdata](const auto& property) {
+                             return property.reply_userdata ==
+                                    registered_reply_userdata;
+                           });
+  auto removed = static_cast<int>(std::distance(it, mpv->observed.end()));
+  mpv->observed.erase(it, mpv->observed.end());
+  return removed;
+}
+
+auto mpv_client_name(mpv_handle* /*ctx*/) -> const char* {
+  return "inhibit";
+}
+
+auto mpv_get_property_string(mpv_handle* ctx, const char* name) -> char* {
+  if (std::string_view{name} != "script-opts") {
+    return nullptr;
+  }
+  // Must be released through mpv_free.
+  auto* copy = static_cast<char*>(std::malloc(ctx->script_opts.size() + 1));
+  std::memcpy(copy, ctx->script_opts.c_str(), ctx->script_opts.size() + 1);
+  return copy;
+}
+
+void mpv_free(void* data) {
+  std::free(data);
+}
+
+auto mpv_error_string(int error) -> const char* {
+  return error < 0 ? "error" : "success";
+}
+}
+
+namespace mpv_shim {
+auto load_plugin(const char* path) -> plugin_entry {
+  void* lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (lib == nullptr) {
+    throw std::runtime_error(dlerror());
+  }
+  auto* entry = dlsym(lib, "mpv_open_cplugin");
+  if (entry == nullptr) {
+    throw std::runtime_error(dlerror());
+  }
+  return reinterpret_cast<plugin_entry>(entry);
+}
+
+auto pause_event(bool paused) -> scripted_event {
+  return {MPV_EVENT_PROPERTY_CHANGE, "pause", paused ? 1 : 0};
+}
+
+auto file_loaded(bool video, bool album_art) -> std::vector<scripted_event> {
+  return {
+      {MPV_EVENT_PROPERTY_CHANGE, "pause", 1},
+      {MPV_EVENT_PROPERTY_CHANGE, "paused-for-cache", 0},
+      {MPV_EVENT_PROPERTY_CHANGE, "idle-active", 0},
+      {MPV_EVENT_PROPERTY_CHANGE, "eof-reached", 0},
+      {MPV_EVENT_PROPERTY_CHANGE, "vid", video ? 1 : 0},
+      {MPV_EVENT_PROPERTY_CHANGE, "window-minimized", 0},
+      {MPV_EVENT_PROPERTY_CHANGE, "current-tracks/video/albumart",
+       album_art ? 1 : 0},
+  };
+}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <mpv/client.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Scripted replacement for a libmpv client handle. The benchmark
+ * executable exports the mpv client functions used by the plugin, so
+ * the plugin resolves them to this shim instead of libmpv when it is
+ * loaded.
+ */
+struct mpv_handle {
+  /**
+   * A single event of the replayed stream. For property changes
+   * `property` names the property and `value` holds its new value,
+   * all other events carry no data.
+   */
+  struct scripted_event {
+    mpv_event_id id;
+    const char* property = nullptr;
+    int64_t value = 0;
+  };
+
+  struct observed_property {
+    std::string name;
+    uint64_t reply_userdata;
+    mpv_format format;
+  };
+
+  std::vector<scripted_event> script;
+  std::size_t next = 0;
+
+  // Once set the next call to mpv_wait_event returns a shutdown event,
+  // regardless of what is left in the script.
+  std::atomic<bool> shutdown{false};
+
+  std::vector<observed_property> observed;
+
+  // Value of the script-opts property.
+  std::string script_opts;
+
+  // Number of events handed to the plugin (including shutdown).
+  std::size_t delivered = 0;
+
+  // Time the plugin came back for the second event, i.e. finished
+  // handling the first one.
+  std::chrono::steady_clock::time_point first_event_handled{};
+
+  // Storage for the event returned by the last mpv_wait_event call.
+  mpv_event current{};
+  mpv_event_property current_property{};
+  int current_flag = 0;
+  int64_t current_int = 0;
+};
+
+namespace mpv_shim {
+using plugin_entry = int (*)(mpv_handle*);
+using scripted_event = mpv_handle::scripted_event;
+
+/**
+ * Load the plugin from its shared object and return its entry point.
+ * @throws std::runtime_error if the plugin cannot be loaded.
+ */
+auto load_plugin(const char* path) -> plugin_entry;
+
+/**
+ * Change of the pause property.
+ */
+auto pause_event(bool paused) -> scripted_event;
+
+/**
+ * Initial property values mpv reports once a paused file with or
+ * without video is loaded. Cover art counts as video track.
+ */
+auto file_loaded(bool video, bool album_art = false)
+    -> std::vector<scripted_event>;
+}
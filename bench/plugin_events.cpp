@@ -0,0 +1,165 @@
+#include <bench.h>
+#include <mock_screensaver.h>
+#include <mpv_shim.h>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Drives the plugin's event loop with scripted event streams. The
+// plugin is loaded from its shared object and resolves the mpv client
+// functions to the shim exported by this executable, while its D-Bus
+// calls are answered by a mock ScreenSaver service on the session bus.
+
+using mpv_shim::file_loaded;
+using mpv_shim::pause_event;
+using mpv_shim::plugin_entry;
+using mpv_shim::scripted_event;
+
+namespace {
+/**
+ * Run the plugin over the given script until it returns and print the
+ * event throughput and the number of D-Bus calls issued per event.
+ */
+void run_stream(const char* label,
+                plugin_entry open_plugin,
+                mock_screensaver& screensaver,
+                std::vector<scripted_event> script) {
+  mpv_handle handle;
+  handle.script = std::move(script);
+  screensaver.reset();
+
+  auto start = bench::clock::now();
+  int res = open_plugin(&handle);
+  auto elapsed =
+      std::chrono::duration<double>(bench::clock::now() - start).count();
+
+  if (res != 0) {
+    throw std::runtime_error("plugin returned an error");
+  }
+
+  auto events = static_cast<double>(handle.delivered);
+  fmt::print("{:<32} {:>12.0f} events/s {:>8.4f} calls/event\n", label,
+             events / elapsed,
+             static_cast<double>(screensaver.calls()) / events);
+}
+
+/**
+ * Request shutdown while the plugin is blocked in an Inhibit call and
+ * measure how long it takes the plugin to return afterwards.
+ */
+void run_shutdown_mid_call(plugin_entry open_plugin,
+                           mock_screensaver& screensaver,
+                           std::chrono::milliseconds delay,
+                           int repetitions) {
+  screensaver.set_reply_delay(delay);
+
+  std::chrono::duration<double, std::milli> total{0};
+  std::chrono::duration<double, std::milli> worst{0};
+  for (int i = 0; i < repetitions; ++i) {
+    mpv_handle handle;
+    // Every run starts without a cookie, so unpausing always issues an
+    // Inhibit call.
+    handle.script = file_loaded(true);
+    handle.script.push_back(pause_event(false));
+    screensaver.reset();
+
+    std::atomic<bool> done{false};
+    bench::clock::time_point requested;
+    std::thread shutdown_thread{[&handle, &screensaver, &done, &requested] {
+      while (!screensaver.in_call.load() && !done.load()) {
+        std::this_thread::yield();
+      }
+      requested = bench::clock::now();
+      handle.shutdown.store(true, std::memory_order_release);
+    }};
+
+    int res = open_plugin(&handle);
+    auto returned = bench::clock::now();
+    done.store(true);
+    shutdown_thread.join();
+
+    if (res != 0) {
+      throw std::runtime_error("plugin returned an error");
+    }
+
+    auto latency =
+        std::chrono::duration<double, std::milli>(returned - requested);
+    total += latency;
+    worst = std::max(worst, latency);
+  }
+
+  screensaver.set_reply_delay(std::chrono::microseconds{0});
+
+  fmt::print("{:<32} {:>8.2f} ms mean {:>8.2f} ms max (reply delay {} ms)\n",
+             "shutdown during Inhibit", total.count() / repetitions,
+             worst.count(), delay.count());
+}
+}
+
+auto main(int argc, const char** argv) -> int {
+  try {
+    std::size_t events = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 0;
+    if (events == 0) {
+      events = 100000;
+    }
+
+    mock_screensaver screensaver;
+    auto open_plugin = mpv_shim::load_plugin(MPV_INHIBIT_PLUGIN);
+
+    // Every event flips the pause state.
+    auto flapping = file_loaded(true);
+    flapping.reserve(flapping.size() + events);
+    for (std::size_t i = 0; i < events; ++i) {
+      flapping.push_back(pause_event(i % 2 != 0));
+    }
+    run_stream("pause flapping", open_plugin, screensaver,
+               std::move(flapping));
+
+    // Without video the screensaver is not inhibited by default.
+    auto audio_only = file_loaded(false);
+    audio_only.reserve(audio_only.size() + events);
+    for (std::size_t i = 0; i < events; ++i) {
+      audio_only.push_back(pause_event(i % 2 != 0));
+    }
+    run_stream("audio-only pause flapping", open_plugin, screensaver,
+               std::move(audio_only));
+
+    // The pause state is reported repeatedly without changing.
+    auto repeated = file_loaded(true);
+    repeated.insert(repeated.end(), events, pause_event(false));
+    run_stream("repeated unpause", open_plugin, screensaver,
+               std::move(repeated));
+
+    // Playback starts and stops once with a flood of events the plugin
+    // does not care about in between.
+    constexpr std::array unrelated{
+        MPV_EVENT_PLAYBACK_RESTART, MPV_EVENT_VIDEO_RECONFIG,
+        MPV_EVENT_AUDIO_RECONFIG, MPV_EVENT_SEEK};
+    auto flood = file_loaded(true);
+    flood.reserve(flood.size() + events + 2);
+    flood.push_back(pause_event(false));
+    for (std::size_t i = 0; i < events; ++i) {
+      flood.push_back({unrelated[i % unrelated.size()]});
+    }
+    flood.push_back(pause_event(true));
+    run_stream("unrelated event flood", open_plugin, screensaver,
+               std::move(flood));
+
+    run_shutdown_mid_call(open_plugin, screensaver,
+                          std::chrono::milliseconds{20}, 20);
+
+    return EXIT_SUCCESS;
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "Unknown error: {}\n", e.what());
+  }
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,193 @@
+#include <bench.h>
+#include <mpv_shim.h>
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <fmt/format.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+// Measures what every start of mpv pays for the plugin: the time to
+// load it, the number of relocations the dynamic linker has to process,
+// the number of exported symbols and the time until the plugin handled
+// its first event. Every load happens in a fresh child process so the
+// plugin is never already mapped.
+
+using mpv_shim::plugin_entry;
+
+namespace {
+struct elf_stats {
+  std::size_t relocations = 0;
+  std::size_t exported_symbols = 0;
+};
+
+/**
+ * Count the dynamic relocations and exported symbols of a 64 bit ELF
+ * shared object.
+ */
+auto read_elf_stats(const char* path) -> elf_stats {
+  std::ifstream in{path, std::ios::binary};
+  std::vector<char> file{std::istreambuf_iterator<char>{in},
+                         std::istreambuf_iterator<char>{}};
+
+  Elf64_Ehdr ehdr{};
+  if (file.size() < sizeof(ehdr)) {
+    throw std::runtime_error("not an ELF file");
+  }
+  std::memcpy(&ehdr, file.data(), sizeof(ehdr));
+  if (std::memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr.e_ident[EI_CLASS] != ELFCLASS64 ||
+      file.size() < ehdr.e_shoff + ehdr.e_shnum * sizeof(Elf64_Shdr)) {
+    throw std::runtime_error("not a 64 bit ELF file");
+  }
+
+  elf_stats stats;
+  for (std::size_t i = 0; i < ehdr.e_shnum; ++i) {
+    Elf64_Shdr shdr{};
+    std::memcpy(&shdr, file.data() + ehdr.e_shoff + i * sizeof(shdr),
+                sizeof(shdr));
+    if (shdr.sh_entsize == 0 || (shdr.sh_flags & SHF_ALLOC) == 0) {
+      continue;
+    }
+
+    std::size_t entries = shdr.sh_size / shdr.sh_entsize;
+    if (shdr.sh_type == SHT_RELA || shdr.sh_type == SHT_REL) {
+      stats.relocations += entries;
+    } else if (shdr.sh_type == SHT_DYNSYM &&
+               shdr.sh_offset + shdr.sh_size <= file.size()) {
+      for (std::size_t j = 0; j < entries; ++j) {
+        Elf64_Sym sym{};
+        std::memcpy(&sym, file.data() + shdr.sh_offset + j * sizeof(sym),
+                    sizeof(sym));
+        auto bind = ELF64_ST_BIND(sym.st_info);
+        if (sym.st_shndx != SHN_UNDEF &&
+            (bind == STB_GLOBAL || bind == STB_WEAK ||
+             bind == STB_GNU_UNIQUE)) {
+          ++stats.exported_symbols;
+        }
+      }
+    }
+  }
+  return stats;
+}
+
+struct load_times {
+  double dlopen_us;
+  double first_event_us;
+};
+
+/**
+ * Load the plugin and run it until it handled its first event. Runs in
+ * the child process.
+ */
+auto load_and_start() -> load_times {
+  mpv_handle handle;
+  handle.script = {{MPV_EVENT_PROPERTY_CHANGE, "pause", 1}};
+
+  auto start = bench::clock::now();
+  void* lib = dlopen(MPV_INHIBIT_PLUGIN, RTLD_NOW | RTLD_LOCAL);
+  auto loaded = bench::clock::now();
+  if (lib == nullptr) {
+    throw std::runtime_error(dlerror());
+  }
+
+  auto* entry = dlsym(lib, "mpv_open_cplugin");
+  if (entry == nullptr) {
+    throw std::runtime_error(dlerror());
+  }
+  if (reinterpret_cast<plugin_entry>(entry)(&handle) != 0) {
+    throw std::runtime_error("plugin returned an error");
+  }
+
+  using micros = std::chrono::duration<double, std::micro>;
+  return {micros(loaded - start).count(),
+          micros(handle.first_event_handled - start).count()};
+}
+
+auto measure_in_child() -> load_times {
+  std::array<int, 2> fds{};
+  if (pipe(fds.data()) != 0) {
+    throw std::runtime_error("cannot create pipe");
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    throw std::runtime_error("cannot fork");
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    int status = EXIT_SUCCESS;
+    try {
+      auto times = load_and_start();
+      if (write(fds[1], &times, sizeof(times)) != sizeof(times)) {
+        status = EXIT_FAILURE;
+      }
+    } catch (const std::exception& e) {
+      fmt::print(stderr, "Unknown error: {}\n", e.what());
+      status = EXIT_FAILURE;
+    }
+    _exit(status);
+  }
+
+  close(fds[1]);
+  load_times times{};
+  auto bytes = read(fds[0], &times, sizeof(times));
+  close(fds[0]);
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if (bytes != sizeof(times) || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != EXIT_SUCCESS) {
+    throw std::runtime_error("loading the plugin failed");
+  }
+  return times;
+}
+
+auto median(std::vector<double> values) -> double {
+  auto middle = values.begin() + static_cast<std::ptrdiff_t>(values.size() / 2);
+  std::nth_element(values.begin(), middle, values.end());
+  return *middle;
+}
+}
+
+auto main(int argc, const char** argv) -> int {
+  try {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 0;
+    if (iterations <= 0) {
+      iterations = 200;
+    }
+
+    auto stats = read_elf_stats(MPV_INHIBIT_PLUGIN);
+    fmt::print("{:<24} {:>10}\n", "dynamic relocations", stats.relocations);
+    fmt::print("{:<24} {:>10}\n", "exported symbols", stats.exported_symbols);
+
+    std::vector<double> dlopen_us;
+    std::vector<double> first_event_us;
+    for (int i = 0; i < iterations; ++i) {
+      auto times = measure_in_child();
+      dlopen_us.push_back(times.dlopen_us);
+      first_event_us.push_back(times.first_event_us);
+    }
+
+    fmt::print("{:<24} {:>10.1f} us median\n", "dlopen",
+               median(dlopen_us));
+    fmt::print("{:<24} {:>10.1f} us median\n", "first event handled",
+               median(first_event_us));
+
+    return EXIT_SUCCESS;
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "Unknown error: {}\n", e.what());
+  }
+  return EXIT_FAILURE;
+}
@@ -2,21 +2,27 @@
 
 #include "message.h"
 
+#include <memory>
+
 struct DBusConnection;
 struct DBusMessage;
 
 namespace offlrofl {
+class recorder;
+
 /**
  * Wrapper class around CBusConnection.
  */
 class connection {
 public:
   /**
-   * Return a connection to the session bus.
+   * Return a connection to the session bus. Traffic is recorded if
+   * enabled through the environment, see recorder::from_environment.
    */
   static auto session() -> connection;
   /**
-   * Return a connection to the system bus.
+   * Return a connection to the system bus. Traffic is recorded if
+   * enabled through the environment, see recorder::from_environment.
    */
   static auto system() -> connection;
 
@@ -33,11 +39,18 @@ public:
    */
   auto send_with_reply(DBusMessage* msg) -> message;
 
+  /**
+   * Record all calls sent through this connection and their replies.
+   * Passing nullptr disables recording.
+   */
+  void record_to(std::shared_ptr<recorder> init_rec);
+
   operator DBusConnection*();
 
 private:
   explicit connection(DBusConnection* initConn);
 
   DBusConnection* conn = nullptr;
+  std::shared_ptr<recorder> rec;
 };
 }
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "connection.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace offlrofl {
+/**
+ * Proxy for a dbus object whose interface is only known at runtime.
+ *
+ * On construction the introspection xml of the object is loaded from
+ * the cache directory (`$XDG_CACHE_HOME/offlrofl`) or, if it is not
+ * cached yet for the current owner of the destination, retrieved over
+ * the bus and written to the cache, replacing the files cached for
+ * earlier owners. The methods of the interface are
+ * then stored in a hash table together with their precomputed
+ * signatures, so a call only has to check and marshal its arguments.
+ */
+class dynamic_proxy {
+public:
+  /**
+   * Argument of a method call. Strings are not copied, they only have
+   * to stay valid until the call returns.
+   */
+  using argument = std::variant<uint8_t,
+                                bool,
+                                int16_t,
+                                uint16_t,
+                                int32_t,
+                                uint32_t,
+                                int64_t,
+                                uint64_t,
+                                const char*>;
+
+  /**
+   * Return value of a method call. Methods without return value return
+   * `std::monostate`.
+   */
+  using result = std::variant<std::monostate,
+                              uint8_t,
+                              bool,
+                              int16_t,
+                              uint16_t,
+                              int32_t,
+                              uint32_t,
+                              int64_t,
+                              uint64_t,
+                              std::string>;
+
+  /**
+   * Description of a single method of the interface.
+   */
+  struct method {
+    std::string name;
+    // One dbus type code per input argument.
+    std::string in_signature;
+    // Dbus type code of the return value or DBUS_TYPE_INVALID for void.
+    int out_type;
+  };
+
+  /**
+   * Create a proxy for the interface `iface` of the object at `path`
+   * owned by `destination` on the session bus.
+   */
+  dynamic_proxy(std::string init_destination,
+                std::string init_path,
+                std::string init_iface);
+
+  dynamic_proxy(const dynamic_proxy&) = delete;
+  auto operator=(const dynamic_proxy&) -> dynamic_proxy& = delete;
+
+  dynamic_proxy(dynamic_proxy&&) = default;
+  auto operator=(dynamic_proxy&&) -> dynamic_proxy& = default;
+
+  ~dynamic_proxy() = default;
+
+  /**
+   * Look up a method by name. Returns nullptr if the interface has no
+   * such method or its signature is not supported. The returned pointer
+   * stays valid for the lifetime of the proxy, so callers on a hot path
+   * should look the method up once and call it through the pointer.
+   */
+  [[nodiscard]] auto find_method(std::string_view name) const
+      -> const method*;
+
+  /**
+   * Call the method with the given name.
+   * @throws std::runtime_error if the method does not exist, the
+   * arguments do not match its signature or the call fails.
+   */
+  auto call(std::string_view name, const std::vector<argument>& args)
+      -> result;
+
+  /**
+   * Call a method previously retrieved through find_method.
+   * @throws std::runtime_error if the arguments do not match the
+   * signature of the method or the call fails.
+   */
+  auto call(const method& m, const std::vector<argument>& args) -> result;
+
+  [[nodiscard]] auto get_destination() const -> const char* {
+    return destination.c_str();
+  }
+  [[nodiscard]] auto get_path() const -> const char* { return path.c_str(); }
+  [[nodiscard]] auto get_interface() const -> const char* {
+    return iface.c_str();
+  }
+
+private:
+  void build_method_table(const std::string& xml);
+
+  connection conn = connection::session();
+
+  std::string destination;
+  std::string path;
+  std::string iface;
+
+  // Storage is filled once on construction and never resized afterwards
+  // so the views used as keys in the lookup table stay valid.
+  std::vector<method> methods;
+  std::unordered_map<std::string_view, std::size_t> method_table;
+};
+}
@@ -5,6 +5,7 @@
 #include <cassert>
 #include <cstdint>
 #include <stdexcept>
+#include <type_traits>
 
 namespace offlrofl {
 /**
@@ -42,7 +43,7 @@ public:
 
   /**
    * Returns the first argument of the message. Currently only supports
-   * basic dbus types, i.e. only `intX_t` and `const char*`.
+   * basic dbus types, i.e. only `bool`, `intX_t` and `const char*`.
    */
   template <typename T>
   [[nodiscard]] auto get_argument() -> T;
@@ -102,8 +103,14 @@ template <typename T, typename... Args>
 inline void append_arguments(DBusMessageIter& iter,
                              T& first_arg,
                              Args&... args) {
-  dbus_message_iter_append_basic(&iter, message_arg_type(first_arg),
-                                 &first_arg);
+  if constexpr (std::is_same_v<std::remove_cv_t<T>, bool>) {
+    // dbus reads booleans as 32 bit dbus_bool_t.
+    dbus_bool_t wide = first_arg ? TRUE : FALSE;
+    dbus_message_iter_append_basic(&iter, DBUS_TYPE_BOOLEAN, &wide);
+  } else {
+    dbus_message_iter_append_basic(&iter, message_arg_type(first_arg),
+                                   &first_arg);
+  }
 
   append_arguments(iter, args...);
 }
@@ -140,9 +147,16 @@ auto message::get_argument() -> T {
     throw std::runtime_error("unexpected argument type");
   }
 
-  T buffer;
-  dbus_message_iter_get_basic(&iter, &buffer);
-  return buffer;
+  if constexpr (std::is_same_v<T, bool>) {
+    // dbus writes booleans as 32 bit dbus_bool_t.
+    dbus_bool_t buffer = FALSE;
+    dbus_message_iter_get_basic(&iter, &buffer);
+    return buffer != FALSE;
+  } else {
+    T buffer;
+    dbus_message_iter_get_basic(&iter, &buffer);
+    return buffer;
+  }
 }
 
 // Overload of void s.t. messages without return values are handled
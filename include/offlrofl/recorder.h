@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct DBusError;
+struct DBusMessage;
+
+namespace offlrofl {
+/**
+ * Appends dbus traffic to a memory mapped ring buffer file. Each record
+ * holds a timestamp, the serial of the call it belongs to and the
+ * marshalled message, so the traffic can later be replayed with
+ * `offlrofl_replay`. When the file is full the oldest records are
+ * overwritten.
+ *
+ * Layout of the file: a `file_header` padded to `data_offset` bytes
+ * followed by `capacity` bytes of records. Every record starts with a
+ * `record_header` at an 8 byte aligned offset. A record never wraps
+ * around the end of the data area, the remaining space is skipped
+ * instead.
+ */
+class recorder {
+public:
+  enum class record_kind : uint8_t {
+    // Outgoing method call.
+    call = 0,
+    // Reply to a method call.
+    reply = 1,
+    // Error reply to a method call. The data holds the error name and
+    // message separated by a null character.
+    error = 2,
+    // Unused space at the end of the data area.
+    padding = 3,
+  };
+
+  struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t capacity;
+    // Positions are offsets into the data area that grow without
+    // wrapping around. The oldest record starts at tail, the next one
+    // is written at head.
+    uint64_t head;
+    uint64_t tail;
+  };
+
+  /**
+   * Time a record was taken. Latencies and offsets between records are
+   * computed from the monotonic time, which is not affected by changes
+   * of the system clock. The wall clock time is only informational.
+   */
+  struct timestamp {
+    // Nanoseconds since the unix epoch.
+    uint64_t wall;
+    // Nanoseconds of CLOCK_MONOTONIC, shared by all processes of a boot.
+    uint64_t monotonic;
+  };
+
+  struct record_header {
+    uint32_t size;
+    record_kind kind;
+    uint8_t reserved[3];
+    uint32_t serial;
+    uint32_t reserved2;
+    timestamp time;
+  };
+
+  /**
+   * A record read back from a recording.
+   */
+  struct record {
+    record_kind kind;
+    uint32_t serial;
+    timestamp time;
+    std::vector<char> data;
+  };
+
+  static constexpr std::size_t data_offset = 64;
+  static constexpr std::size_t default_capacity = std::size_t{4} << 20U;
+
+  /**
+   * Open or create the recording at `path`. Records of an existing
+   * recording with the same capacity are kept, other existing files
+   * are never overwritten. Every `%p` in the path is replaced by the
+   * process id. The file is locked for as long as the recorder exists,
+   * a recording in use by another process is not opened again.
+   * @throws std::runtime_error if the file is not a recording or cannot
+   * be locked or mapped.
+   */
+  explicit recorder(const std::string& path,
+                    std::size_t capacity = default_capacity);
+
+  recorder(const recorder&) = delete;
+  recorder(recorder&&) = delete;
+  auto operator=(const recorder&) -> recorder& = delete;
+  auto operator=(recorder&&) -> recorder& = delete;
+
+  ~recorder();
+
+  /**
+   * Return the recorder configured through the environment or nullptr
+   * if recording is disabled. Recording is enabled by setting
+   * `OFFLROFL_RECORD` to the path of the recording, its capacity in
+   * bytes may be set through `OFFLROFL_RECORD_SIZE`. The recorder is
+   * shared by all connections of the process. If another process is
+   * already recording to the path, the process id is appended to it.
+   */
+  static auto from_environment() -> std::shared_ptr<recorder>;
+
+  /**
+   * Return the current time.
+   */
+  static auto now() -> timestamp;
+
+  /**
+   * Record a marshalled copy of the message.
+   */
+  void append(record_kind kind,
+              uint32_t serial,
+              timestamp time,
+              DBusMessage* msg);
+
+  /**
+   * Record an error reply.
+   */
+  void append(uint32_t serial, timestamp time, const DBusError* err);
+
+  /**
+   * Read all records of a recording, oldest first.
+   * @throws std::runtime_error if the file is not a valid recording.
+   */
+  static auto read(const std::string& path) -> std::vector<record>;
+
+private:
+  void append(record_kind kind,
+              uint32_t serial,
+              timestamp time,
+              const char* data,
+              std::size_t size);
+  void make_room(uint64_t head, std::size_t size);
+
+  std::mutex mutex;
+  int fd = -1;
+  file_header* header = nullptr;
+  char* data = nullptr;
+  std::size_t mapped_size = 0;
+};
+}
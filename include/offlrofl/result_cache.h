@@ -0,0 +1,151 @@
+#pragma once
+
+#include "connection.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+
+namespace offlrofl {
+/**
+ * Cache for results of idempotent methods, used by generated proxies
+ * for methods marked as cacheable. Results are kept per method and
+ * argument tuple until their time to live expires or the unique name
+ * owning the destination changes, e.g. because the service restarted.
+ */
+class result_cache {
+public:
+  using clock = std::chrono::steady_clock;
+
+  using value = std::variant<bool,
+                             uint8_t,
+                             int16_t,
+                             uint16_t,
+                             int32_t,
+                             uint32_t,
+                             int64_t,
+                             uint64_t,
+                             std::string>;
+
+  /**
+   * Counters to judge whether caching a method pays off.
+   */
+  struct stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Number of times the cache was cleared because the owner of the
+    // destination changed.
+    uint64_t invalidations = 0;
+  };
+
+  result_cache();
+
+  result_cache(const result_cache&) = delete;
+  auto operator=(const result_cache&) -> result_cache& = delete;
+
+  result_cache(result_cache&&) noexcept;
+  auto operator=(result_cache&&) noexcept -> result_cache&;
+
+  ~result_cache();
+
+  /**
+   * Build the key identifying a call of `method` with the given
+   * arguments.
+   */
+  template <typename... Args>
+  [[nodiscard]] static auto make_key(const char* method, const Args&... args)
+      -> std::string;
+
+  /**
+   * Return the cached result for `key` if there is one that has not
+   * expired. The first call starts watching the owner of `destination`
+   * on `conn`.
+   */
+  template <typename T>
+  [[nodiscard]] auto get(connection& conn,
+                         const char* destination,
+                         const std::string& key) -> std::optional<T>;
+
+  /**
+   * Store the result of a call for the given time. Expired results are
+   * dropped, also those of argument tuples not looked up again.
+   */
+  template <typename T>
+  void put(const std::string& key, T result, std::chrono::milliseconds ttl) {
+    insert(key, value{std::move(result)}, ttl);
+  }
+
+  [[nodiscard]] auto get_stats() const -> const stats& { return counters; }
+
+  /**
+   * Return the number of stored results.
+   */
+  [[nodiscard]] auto size() const -> std::size_t { return entries.size(); }
+
+private:
+  class owner_watch;
+
+  struct entry {
+    value result;
+    clock::time_point expires;
+  };
+
+  /**
+   * Look up a valid entry, updating the statistics.
+   */
+  auto find(connection& conn, const char* destination, const std::string& key)
+      -> const entry*;
+
+  void insert(const std::string& key,
+              value result,
+              std::chrono::milliseconds ttl);
+
+  /**
+   * Drop all entries expired at `now`. Only scans the entries if the
+   * earliest one expired.
+   */
+  void prune(clock::time_point now);
+
+  static void append_key(std::string& key, const char* arg) {
+    key.push_back('\0');
+    key.append(arg);
+  }
+
+  template <typename T>
+  static void append_key(std::string& key, T arg) {
+    key.push_back('\0');
+    key.append(std::to_string(arg));
+  }
+
+  std::unordered_map<std::string, entry> entries;
+  clock::time_point earliest_expiry = clock::time_point::max();
+  std::unique_ptr<owner_watch> watch;
+  uint64_t generation = 0;
+  stats counters;
+};
+
+template <typename... Args>
+auto result_cache::make_key(const char* method, const Args&... args)
+    -> std::string {
+  std::string key = method;
+  (append_key(key, args), ...);
+  return key;
+}
+
+template <typename T>
+auto result_cache::get(connection& conn,
+                       const char* destination,
+                       const std::string& key) -> std::optional<T> {
+  const auto* cached = find(conn, destination, key);
+  if (cached == nullptr) {
+    return std::nullopt;
+  }
+  return std::get<T>(cached->result);
+}
+}
@@ -1,9 +1,10 @@
 #include <screensaver_interface.h>
 
-#include <fmt/format.h>
 #include <mpv/client.h>
 
+#include <array>
 #include <cstdint>
+#include <cstdio>
 #include <string_view>
 #if defined(WIN32)
 #define WIN32_LEAN_AND_MEAN
@@ -25,6 +26,14 @@ constexpr auto os_text(os_str_type x) -> os_str_type {
 }
 #endif
 
+// The plugin may be built with hidden visibility, mpv only needs to find
+// the entry point.
+#if defined(WIN32)
+#define MPV_INHIBIT_EXPORT __declspec(dllexport)
+#else
+#define MPV_INHIBIT_EXPORT __attribute__((visibility("default")))
+#endif
+
 static void set_thread_name(os_str_type name) {
 #if defined(WIN32)
   SetThreadDescription(GetCurrentThread(), name);
@@ -35,18 +44,178 @@ static void set_thread_name(os_str_type name) {
 #endif
 }
 
-constexpr uint64_t L33T = 1337;
+/**
+ * Properties the plugin observes. The values are used as reply
+ * userdata to tell the property change events apart.
+ */
+enum class observed : uint64_t {
+  pause = 1,
+  paused_for_cache,
+  idle_active,
+  eof_reached,
+  vid,
+  window_minimized,
+  album_art,
+};
+
+struct observed_property {
+  observed id;
+  const char* name;
+  mpv_format format;
+};
 
-static void unpause(org_freedesktop_ScreenSaver& screen_saver,
+constexpr std::array<observed_property, 7> observed_properties{{
+    {observed::pause, "pause", MPV_FORMAT_FLAG},
+    // Unlike core-idle this is not set while playback restarts after
+    // every seek, which would cost two calls per seek.
+    {observed::paused_for_cache, "paused-for-cache", MPV_FORMAT_FLAG},
+    {observed::idle_active, "idle-active", MPV_FORMAT_FLAG},
+    {observed::eof_reached, "eof-reached", MPV_FORMAT_FLAG},
+    // "no" cannot be converted to an integer and is reported without
+    // data, as is an unavailable property.
+    {observed::vid, "vid", MPV_FORMAT_INT64},
+    {observed::window_minimized, "window-minimized", MPV_FORMAT_FLAG},
+    // Embedded cover art of audio files is selected as a video track.
+    {observed::album_art, "current-tracks/video/albumart", MPV_FORMAT_FLAG},
+}};
+
+/**
+ * Last known values of the observed properties. mpv reports the
+ * initial value of every property right after it is observed, so the
+ * defaults only matter until then.
+ */
+struct playback_state {
+  bool paused = true;
+  bool paused_for_cache = false;
+  bool idle_active = false;
+  bool eof_reached = false;
+  bool has_video = false;
+  bool window_minimized = false;
+  bool album_art = false;
+};
+
+/**
+ * Situations in which the screensaver is inhibited even though nothing
+ * is visible on screen. Configured through `script-opts`, e.g.
+ * `--script-opts=inhibit-audio-only=yes`.
+ */
+struct inhibit_policy {
+  // Inhibit while playing files without a video track or with only
+  // cover art.
+  bool audio_only = false;
+  // Inhibit while the window is minimized.
+  bool minimized = false;
+  // Keep inhibiting while playback is stalled waiting for the cache.
+  bool buffering = false;
+};
+
+static auto parse_flag(std::string_view value, bool fallback) -> bool {
+  if (value == "yes" || value == "true" || value == "1") {
+    return true;
+  }
+  if (value == "no" || value == "false" || value == "0") {
+    return false;
+  }
+  return fallback;
+}
+
+static auto read_policy(mpv_handle* handle) -> inhibit_policy {
+  inhibit_policy policy;
+
+  char* opts = mpv_get_property_string(handle, "script-opts");
+  if (opts == nullptr) {
+    return policy;
+  }
+
+  // The option list is formatted as key1=value1,key2=value2,...
+  std::string_view rest = opts;
+  while (!rest.empty()) {
+    auto end = rest.find(',');
+    auto entry = rest.substr(0, end);
+    rest = end == std::string_view::npos ? "" : rest.substr(end + 1);
+
+    auto separator = entry.find('=');
+    if (separator == std::string_view::npos) {
+      continue;
+    }
+    auto key = entry.substr(0, separator);
+    auto value = entry.substr(separator + 1);
+    if (key == "inhibit-audio-only") {
+      policy.audio_only = parse_flag(value, policy.audio_only);
+    } else if (key == "inhibit-minimized") {
+      policy.minimized = parse_flag(value, policy.minimized);
+    } else if (key == "inhibit-buffering") {
+      policy.buffering = parse_flag(value, policy.buffering);
+    }
+  }
+
+  mpv_free(opts);
+  return policy;
+}
+
+static void update_state(playback_state& state,
+                         observed id,
+                         const mpv_event_property& property) {
+  // Unavailable properties are reported without data, treat them as
+  // unset.
+  bool flag = false;
+  if (property.format == MPV_FORMAT_FLAG && property.data != nullptr) {
+    flag = *static_cast<int*>(property.data) != 0;
+  } else if (property.format == MPV_FORMAT_INT64 && property.data != nullptr) {
+    flag = *static_cast<int64_t*>(property.data) > 0;
+  }
+
+  switch (id) {
+  case observed::pause:
+    state.paused = flag;
+    break;
+  case observed::paused_for_cache:
+    state.paused_for_cache = flag;
+    break;
+  case observed::idle_active:
+    state.idle_active = flag;
+    break;
+  case observed::eof_reached:
+    state.eof_reached = flag;
+    break;
+  case observed::vid:
+    state.has_video = flag;
+    break;
+  case observed::window_minimized:
+    state.window_minimized = flag;
+    break;
+  case observed::album_art:
+    state.album_art = flag;
+    break;
+  }
+}
+
+static auto needs_inhibit(const playback_state& state,
+                          const inhibit_policy& policy) -> bool {
+  if (state.paused || state.idle_active || state.eof_reached) {
+    return false;
+  }
+  if (state.paused_for_cache && !policy.buffering) {
+    return false;
+  }
+  bool audio_only = !state.has_video || state.album_art;
+  if (audio_only && !policy.audio_only) {
+    return false;
+  }
+  return !state.window_minimized || policy.minimized;
+}
+
+static void inhibit(org_freedesktop_ScreenSaver& screen_saver,
                     uint32_t& cookie) {
-  // New state: unpaused, deactivate screensaver
+  // New state: playing, deactivate screensaver
   if (cookie == 0) {
     cookie = screen_saver.Inhibit("mpv", "playing movie");
   }
 }
 
-static void pause(org_freedesktop_ScreenSaver& screen_saver, uint32_t& cookie) {
-  // New state: paused, reactivate screensaver
+static void uninhibit(org_freedesktop_ScreenSaver& screen_saver,
+                      uint32_t& cookie) {
+  // New state: not playing, reactivate screensaver
   if (cookie != 0) {
     screen_saver.UnInhibit(cookie);
     cookie = 0;
@@ -54,19 +223,26 @@ static void pause(org_freedesktop_ScreenSaver& screen_saver, uint32_t& cookie) {
 }
 
 extern "C" {
-auto mpv_open_cplugin(mpv_handle* handle) -> int {
+MPV_INHIBIT_EXPORT auto mpv_open_cplugin(mpv_handle* handle) -> int {
   try {
     set_thread_name(os_text("mpv/inhibit"));
 
     org_freedesktop_ScreenSaver screen_saver;
 
     uint32_t cookie = 0;
+    playback_state state;
+    auto policy = read_policy(handle);
 
-    auto res = mpv_observe_property(handle, L33T, "pause", MPV_FORMAT_FLAG);
-    if (res < 0) {
-      fmt::print("Cannot register property observer. Error: {}",
-                 mpv_error_string(res));
-      return -1;
+    for (const auto& property : observed_properties) {
+      auto res =
+          mpv_observe_property(handle, static_cast<uint64_t>(property.id),
+                               property.name, property.format);
+      if (res < 0) {
+        std::fprintf(stderr,
+                     "Cannot register property observer for %s. Error: %s\n",
+                     property.name, mpv_error_string(res));
+        return -1;
+      }
     }
 
     // Enter event loop
@@ -77,21 +253,26 @@ auto mpv_open_cplugin(mpv_handle* handle) -> int {
       case MPV_EVENT_SHUTDOWN:
         return 0;
 
-      case MPV_EVENT_PROPERTY_CHANGE:
+      case MPV_EVENT_PROPERTY_CHANGE: {
         // Should always be set but check just in case.
-        if (evt->reply_userdata == L33T) {
-          auto* data = static_cast<mpv_event_property*>(evt->data);
-          // Should never be somethimg else but check just in case.
-          if (data->format == MPV_FORMAT_FLAG && data->data != nullptr) {
-            int flag = *static_cast<int*>(data->data);
-            if (flag != 0) {
-              pause(screen_saver, cookie);
-            } else {
-              unpause(screen_saver, cookie);
-            }
-          }
+        auto id = evt->reply_userdata;
+        if (id < static_cast<uint64_t>(observed::pause) ||
+            id > static_cast<uint64_t>(observed::album_art) ||
+            evt->data == nullptr) {
+          break;
         }
 
+        update_state(state, static_cast<observed>(id),
+                     *static_cast<mpv_event_property*>(evt->data));
+        // Both only issue a call if the derived state flipped.
+        if (needs_inhibit(state, policy)) {
+          inhibit(screen_saver, cookie);
+        } else {
+          uninhibit(screen_saver, cookie);
+        }
+        break;
+      }
+
       default:
         break;
       }
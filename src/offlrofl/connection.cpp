@@ -1,8 +1,10 @@
 #include <offlrofl/connection.h>
 #include <offlrofl/error.h>
 #include <offlrofl/message.h>
+#include <offlrofl/recorder.h>
 
 #include <cassert>
+#include <utility>
 
 extern "C" {
 #include <dbus/dbus.h>
@@ -16,7 +18,9 @@ auto connection::session() -> connection {
   DBusConnection* conn = dbus_bus_get(DBUS_BUS_SESSION, err);
   err.throw_if_error();
 
-  return connection{conn};
+  auto result = connection{conn};
+  result.record_to(recorder::from_environment());
+  return result;
 }
 
 auto connection::system() -> connection {
@@ -26,15 +30,19 @@ auto connection::system() -> connection {
   DBusConnection* conn = dbus_bus_get(DBUS_BUS_SYSTEM, err);
   err.throw_if_error();
 
-  return connection{conn};
+  auto result = connection{conn};
+  result.record_to(recorder::from_environment());
+  return result;
 }
 
-connection::connection(connection&& other) noexcept : conn{other.conn} {
+connection::connection(connection&& other) noexcept
+    : conn{other.conn}, rec{std::move(other.rec)} {
   other.conn = nullptr;
 }
 
 auto connection::operator=(connection&& other) noexcept -> connection& {
   std::swap(conn, other.conn);
+  std::swap(rec, other.rec);
 
   return *this;
 }
@@ -47,12 +55,36 @@ connection::~connection() {
 
 auto connection::send_with_reply(DBusMessage* msg) -> message {
   error err;
+  if (rec == nullptr) {
+    auto* reply =
+        dbus_connection_send_with_reply_and_block(*this, msg, -1, err);
+    err.throw_if_error();
+
+    return message::wrap(reply);
+  }
+
+  // The serial is assigned on sending, so the call can only be recorded
+  // afterwards.
+  auto sent = recorder::now();
   auto* reply = dbus_connection_send_with_reply_and_block(*this, msg, -1, err);
+  auto received = recorder::now();
+
+  auto serial = dbus_message_get_serial(msg);
+  rec->append(recorder::record_kind::call, serial, sent, msg);
+  if (err.is_error()) {
+    rec->append(serial, received, err);
+  } else {
+    rec->append(recorder::record_kind::reply, serial, received, reply);
+  }
   err.throw_if_error();
 
   return message::wrap(reply);
 }
 
+void connection::record_to(std::shared_ptr<recorder> init_rec) {
+  rec = std::move(init_rec);
+}
+
 connection::operator DBusConnection*() {
   return conn;
 }
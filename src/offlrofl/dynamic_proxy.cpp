@@ -0,0 +1,430 @@
+#include <offlrofl/dynamic_proxy.h>
+#include <offlrofl/error.h>
+#include <offlrofl/message.h>
+
+#include <pugixml.hpp>
+
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <unistd.h>
+
+extern "C" {
+#include <dbus/dbus.h>
+}
+
+using namespace std::string_view_literals;
+
+namespace {
+/**
+ * Return the directory introspection data is cached in or an empty
+ * path if no suitable directory can be determined.
+ */
+auto cache_directory() -> std::filesystem::path {
+  if (const char* xdg = std::getenv("XDG_CACHE_HOME");
+      xdg != nullptr && *xdg != '\0') {
+    return std::filesystem::path{xdg} / "offlrofl";
+  }
+  if (const char* home = std::getenv("HOME");
+      home != nullptr && *home != '\0') {
+    return std::filesystem::path{home} / ".cache" / "offlrofl";
+  }
+  return {};
+}
+
+/**
+ * Escape '_' as well as '/' so distinct keys never map to the same file
+ * name.
+ */
+auto escape_file_name(const std::string& key) -> std::string {
+  std::string name;
+  name.reserve(key.size() + 4);
+  for (char c : key) {
+    if (c == '/') {
+      name.append("_2f");
+    } else if (c == '_') {
+      name.append("_5f");
+    } else {
+      name.push_back(c);
+    }
+  }
+  return name;
+}
+
+/**
+ * Return the prefix shared by the names of all cache files of an
+ * object. Neither bus names nor object paths contain '@'.
+ */
+auto cache_file_prefix(const std::string& destination, const std::string& path)
+    -> std::string {
+  return escape_file_name(destination + "@" + path + "@");
+}
+
+/**
+ * Build the file name the introspection data of an object is cached
+ * under. The unique name of the owner is part of the key so a
+ * restarted (and possibly updated) service is introspected again.
+ * Unique names are reused by every new bus instance, so the id of the
+ * bus is part of the key as well.
+ */
+auto cache_file_name(const std::string& bus_id,
+                     const std::string& destination,
+                     const std::string& owner,
+                     const std::string& path) -> std::string {
+  return cache_file_prefix(destination, path) +
+         escape_file_name(bus_id + "@" + owner) + ".xml";
+}
+
+/**
+ * Remove the files cached for earlier owners or buses of the object
+ * cached in `file`, otherwise every restart of the service would leave
+ * a file behind.
+ */
+void remove_stale_files(const std::filesystem::path& file,
+                        const std::string& prefix) {
+  std::error_code ec;
+  std::filesystem::directory_iterator it{file.parent_path(), ec};
+  for (; !ec && it != std::filesystem::directory_iterator{};
+       it.increment(ec)) {
+    const auto& entry = it->path();
+    auto name = entry.filename().string();
+    // Temporary files of concurrent writers do not end in ".xml".
+    if (entry != file && entry.extension() == ".xml" &&
+        name.compare(0, prefix.size(), prefix) == 0) {
+      std::error_code remove_ec;
+      std::filesystem::remove(entry, remove_ec);
+    }
+  }
+}
+
+auto read_file(const std::filesystem::path& file)
+    -> std::optional<std::string> {
+  std::ifstream in{file, std::ios::binary};
+  if (!in) {
+    return std::nullopt;
+  }
+  return std::string{std::istreambuf_iterator<char>{in},
+                     std::istreambuf_iterator<char>{}};
+}
+
+/**
+ * Write the file through a temporary so concurrent readers never see a
+ * partially written file. Failing to cache is not an error, the data
+ * is simply retrieved again next time.
+ */
+void write_file(const std::filesystem::path& file, const std::string& data) {
+  std::error_code ec;
+  std::filesystem::create_directories(file.parent_path(), ec);
+  if (ec) {
+    return;
+  }
+
+  // Every process writes its own temporary file.
+  std::string tmp = file.string() + ".XXXXXX";
+  int fd = mkstemp(tmp.data());
+  if (fd < 0) {
+    return;
+  }
+
+  const char* pos = data.data();
+  std::size_t remaining = data.size();
+  while (remaining > 0) {
+    auto written = write(fd, pos, remaining);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      break;
+    }
+    pos += written;
+    remaining -= static_cast<std::size_t>(written);
+  }
+
+  if (close(fd) != 0 || remaining > 0) {
+    std::filesystem::remove(tmp, ec);
+    return;
+  }
+  std::filesystem::rename(tmp, file, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+  }
+}
+
+auto get_bus_id(offlrofl::connection& conn) -> std::string {
+  offlrofl::error err;
+  char* raw = dbus_bus_get_id(conn, err);
+  err.throw_if_error();
+
+  std::string id = raw;
+  dbus_free(raw);
+  return id;
+}
+
+/**
+ * Return the unique name owning `name` or nothing if the name has no
+ * owner, e.g. because it belongs to an activatable service that is not
+ * running yet.
+ */
+auto get_name_owner(offlrofl::connection& conn, const std::string& name)
+    -> std::optional<std::string> {
+  // Unique names are their own owner.
+  if (!name.empty() && name[0] == ':') {
+    return name;
+  }
+
+  const char* arg = name.c_str();
+  auto msg = offlrofl::message::method_call(
+      DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS, "GetNameOwner",
+      arg);
+  try {
+    auto reply = conn.send_with_reply(msg);
+    return std::string{reply.get_argument<const char*>()};
+  } catch (const std::runtime_error&) {
+    return std::nullopt;
+  }
+}
+
+auto introspect(offlrofl::connection& conn,
+                const std::string& destination,
+                const std::string& path) -> std::string {
+  auto msg = offlrofl::message::method_call(destination.c_str(), path.c_str(),
+                                            DBUS_INTERFACE_INTROSPECTABLE,
+                                            "Introspect");
+  auto reply = conn.send_with_reply(msg);
+  return reply.get_argument<const char*>();
+}
+
+/**
+ * Return the dbus type code of a single complete basic type signature
+ * or DBUS_TYPE_INVALID if the signature is not supported.
+ */
+auto basic_type(std::string_view signature) -> int {
+  if (signature.size() != 1) {
+    return DBUS_TYPE_INVALID;
+  }
+  switch (signature[0]) {
+  case DBUS_TYPE_BYTE:
+  case DBUS_TYPE_BOOLEAN:
+  case DBUS_TYPE_INT16:
+  case DBUS_TYPE_UINT16:
+  case DBUS_TYPE_INT32:
+  case DBUS_TYPE_UINT32:
+  case DBUS_TYPE_INT64:
+  case DBUS_TYPE_UINT64:
+  case DBUS_TYPE_STRING:
+    return signature[0];
+  default:
+    return DBUS_TYPE_INVALID;
+  }
+}
+
+/**
+ * Return the dbus type code an argument is marshalled as.
+ */
+auto argument_type(const offlrofl::dynamic_proxy::argument& arg) -> int {
+  return std::visit(
+      [](auto value) { return offlrofl::detail::message_arg_type(value); },
+      arg);
+}
+
+void append_argument(DBusMessageIter& iter,
+                     const offlrofl::dynamic_proxy::argument& arg) {
+  std::visit(
+      [&iter](auto value) {
+        if constexpr (std::is_same_v<decltype(value), bool>) {
+          // dbus expects booleans to be 32 bit wide.
+          dbus_bool_t wide = value ? TRUE : FALSE;
+          dbus_message_iter_append_basic(&iter, DBUS_TYPE_BOOLEAN, &wide);
+        } else {
+          dbus_message_iter_append_basic(
+              &iter, offlrofl::detail::message_arg_type(value), &value);
+        }
+      },
+      arg);
+}
+
+template <typename T>
+auto read_basic(DBusMessageIter& iter) -> T {
+  T buffer{};
+  dbus_message_iter_get_basic(&iter, &buffer);
+  return buffer;
+}
+
+auto read_result(offlrofl::message& reply, int type)
+    -> offlrofl::dynamic_proxy::result {
+  if (type == DBUS_TYPE_INVALID) {
+    return std::monostate{};
+  }
+
+  DBusMessageIter iter;
+  if (dbus_message_iter_init(reply, &iter) == FALSE ||
+      dbus_message_iter_get_arg_type(&iter) != type) {
+    throw std::runtime_error("unexpected argument type");
+  }
+
+  switch (type) {
+  case DBUS_TYPE_BYTE:
+    return read_basic<uint8_t>(iter);
+  case DBUS_TYPE_BOOLEAN:
+    return read_basic<dbus_bool_t>(iter) != FALSE;
+  case DBUS_TYPE_INT16:
+    return read_basic<int16_t>(iter);
+  case DBUS_TYPE_UINT16:
+    return read_basic<uint16_t>(iter);
+  case DBUS_TYPE_INT32:
+    return read_basic<int32_t>(iter);
+  case DBUS_TYPE_UINT32:
+    return read_basic<uint32_t>(iter);
+  case DBUS_TYPE_INT64:
+    return read_basic<int64_t>(iter);
+  case DBUS_TYPE_UINT64:
+    return read_basic<uint64_t>(iter);
+  case DBUS_TYPE_STRING:
+    // The string is owned by the reply, so copy it.
+    return std::string{read_basic<const char*>(iter)};
+  default:
+    throw std::runtime_error("unexpected argument type");
+  }
+}
+}
+
+namespace offlrofl {
+dynamic_proxy::dynamic_proxy(std::string init_destination,
+                             std::string init_path,
+                             std::string init_iface)
+    : destination{std::move(init_destination)},
+      path{std::move(init_path)},
+      iface{std::move(init_iface)} {
+  std::optional<std::string> xml;
+  auto owner = get_name_owner(conn, destination);
+  if (!owner) {
+    // Calling the service activates it, afterwards it has an owner.
+    xml = introspect(conn, destination, path);
+    owner = get_name_owner(conn, destination);
+  }
+
+  auto dir = cache_directory();
+  std::filesystem::path file;
+  if (!dir.empty() && owner) {
+    file = dir / cache_file_name(get_bus_id(conn), destination, *owner, path);
+  }
+
+  if (!xml && !file.empty()) {
+    if (auto cached = read_file(file)) {
+      try {
+        build_method_table(*cached);
+        return;
+      } catch (const std::runtime_error&) {
+        // The cached file is corrupt, introspect again and replace it.
+      }
+    }
+  }
+
+  if (!xml) {
+    xml = introspect(conn, destination, path);
+  }
+  if (!file.empty()) {
+    write_file(file, *xml);
+    remove_stale_files(file, cache_file_prefix(destination, path));
+  }
+  build_method_table(*xml);
+}
+
+auto dynamic_proxy::find_method(std::string_view name) const
+    -> const method* {
+  auto it = method_table.find(name);
+  if (it == method_table.end()) {
+    return nullptr;
+  }
+  return &methods[it->second];
+}
+
+auto dynamic_proxy::call(std::string_view name,
+                         const std::vector<argument>& args) -> result {
+  const auto* m = find_method(name);
+  if (m == nullptr) {
+    throw std::runtime_error("unknown method");
+  }
+  return call(*m, args);
+}
+
+auto dynamic_proxy::call(const method& m, const std::vector<argument>& args)
+    -> result {
+  if (args.size() != m.in_signature.size()) {
+    throw std::runtime_error("wrong number of arguments");
+  }
+  for (std::size_t i = 0; i < args.size(); ++i) {
+    if (argument_type(args[i]) != m.in_signature[i]) {
+      throw std::runtime_error("unexpected argument type");
+    }
+  }
+
+  auto msg = message::wrap(dbus_message_new_method_call(
+      get_destination(), get_path(), get_interface(), m.name.c_str()));
+
+  DBusMessageIter iter;
+  dbus_message_iter_init_append(msg, &iter);
+  for (const auto& arg : args) {
+    append_argument(iter, arg);
+  }
+
+  auto reply = conn.send_with_reply(msg);
+  return read_result(reply, m.out_type);
+}
+
+void dynamic_proxy::build_method_table(const std::string& xml) {
+  methods.clear();
+  method_table.clear();
+
+  pugi::xml_document doc;
+  pugi::xml_parse_result res = doc.load_string(xml.c_str());
+  if (!res) {
+    throw std::runtime_error(res.description());
+  }
+
+  auto interface =
+      doc.child("node").find_child_by_attribute("interface", "name",
+                                                iface.c_str());
+  if (!interface) {
+    throw std::runtime_error("interface not found");
+  }
+
+  for (auto node : interface.children("method")) {
+    method m{node.attribute("name").value(), {}, DBUS_TYPE_INVALID};
+
+    bool supported = true;
+    for (auto arg : node.children("arg")) {
+      int type = basic_type(arg.attribute("type").value());
+      const auto* direction = arg.attribute("direction").value();
+      if (type == DBUS_TYPE_INVALID) {
+        supported = false;
+      } else if (direction == "out"sv) {
+        // Only a single return value is supported.
+        supported = supported && m.out_type == DBUS_TYPE_INVALID;
+        m.out_type = type;
+      } else {
+        // Method arguments default to 'in' if no direction is given.
+        m.in_signature.push_back(static_cast<char>(type));
+      }
+    }
+
+    if (supported) {
+      methods.push_back(std::move(m));
+    }
+  }
+
+  method_table.reserve(methods.size());
+  for (std::size_t i = 0; i < methods.size(); ++i) {
+    method_table.emplace(methods[i].name, i);
+  }
+}
+}
@@ -2,43 +2,89 @@
 #include <offlrofl/message.h>
 
 #include <fmt/format.h>
+#include <fmt/os.h>
 #include <pugixml.hpp>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <optional>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 constexpr auto preamble = R"(
 #pragma once
 
 #include <offlrofl/connection.h>
 #include <offlrofl/message.h>
-
+{cache_includes}
 #include <cstdint>
 #include <string>
 
 // Generated from {name}
 )";
 
-constexpr auto class_template = R"(
+// Only emitted if results of any method are cached, so proxies without
+// cacheable methods do not depend on result_cache. The snippets are
+// inserted as arguments and thus do not escape braces.
+constexpr auto cache_includes = R"(#include <offlrofl/result_cache.h>
+
+#include <chrono>)";
+
+constexpr auto cache_stats = R"(
+  [[nodiscard]] auto get_cache_stats() const -> const offlrofl::result_cache::stats& { return cache.get_stats(); }
+)";
+
+constexpr auto cache_member = R"(  offlrofl::result_cache cache;
+)";
+
+constexpr auto call_cached = R"(
+  template <typename ReturnType, typename... Args>
+  auto call_cached(std::chrono::milliseconds ttl, const char* name, Args... args) -> ReturnType {
+    auto key = offlrofl::result_cache::make_key(name, args...);
+    if (auto cached = cache.get<ReturnType>(conn, get_destination(), key)) {
+      return *cached;
+    }
+
+    auto result = call<ReturnType>(name, args...);
+    cache.put(key, result, ttl);
+    return result;
+  }
+)";
+
+// The methods of the class are written between class_header and
+// class_footer.
+constexpr auto class_header = R"(
 class {class} {{
 public:
   {class}() = default;
   {class}(const char* init_destination, const char* init_path)
       : destination{{init_destination}}, path{{init_path}} {{}}
 
-{methods}
+)";
+
+constexpr auto class_footer = R"(
 
   [[nodiscard]] auto get_destination() const -> const char* {{ return destination; }}
   [[nodiscard]] auto get_path() const -> const char* {{ return path; }}
   [[nodiscard]] static auto get_interface() -> const char* {{ return iface; }}
-
+{cache_stats}
 private:
   offlrofl::connection conn = offlrofl::connection::session();
-
+{cache_member}
   const char* destination = "{destination}";
   const char* path = "{path}";
   static inline const char* iface = "{interface}";
@@ -67,7 +113,7 @@ private:
       return reply.get_argument<ReturnType>();
     }}
   }}
-}};
+{call_cached}}};
 )";
 
 using namespace std::string_view_literals;
@@ -120,6 +166,210 @@ private:
   }
 };
 
+/**
+ * Destination of the generated code. Without a path the code is written
+ * to stdout. Otherwise it is written to a uniquely named temporary file
+ * through a buffered writer and only replaces the output file on commit
+ * if the content changed, so the timestamp of an unchanged file is kept
+ * and code including it is not rebuilt.
+ */
+class code_writer {
+public:
+  explicit code_writer(std::optional<std::string> init_path)
+      : path{std::move(init_path)} {
+    if (path) {
+      tmp_path = create_temporary(*path);
+      file.emplace(fmt::output_file(tmp_path, fmt::buffer_size = 1 << 16));
+    }
+  }
+
+  code_writer(const code_writer&) = delete;
+  code_writer(code_writer&&) = delete;
+  auto operator=(const code_writer&) -> code_writer& = delete;
+  auto operator=(code_writer&&) -> code_writer& = delete;
+
+  ~code_writer() {
+    if (file) {
+      // Not committed, discard the partial output. Flushing it may fail,
+      // which does not matter as it is removed anyway.
+      try {
+        file->close();
+      } catch (const std::system_error&) {
+      }
+      std::error_code ec;
+      std::filesystem::remove(tmp_path, ec);
+    }
+  }
+
+  template <typename... Args>
+  void print(fmt::format_string<Args...> format, Args&&... args) {
+    if (file) {
+      file->print(format, std::forward<Args>(args)...);
+    } else {
+      fmt::print(format, std::forward<Args>(args)...);
+    }
+  }
+
+  /**
+   * Finish writing. Returns false if the output file was unchanged.
+   */
+  auto commit() -> bool {
+    if (!file) {
+      return true;
+    }
+
+    file->close();
+    file.reset();
+
+    if (same_content(tmp_path, *path)) {
+      std::filesystem::remove(tmp_path);
+      return false;
+    }
+    std::filesystem::rename(tmp_path, *path);
+    return true;
+  }
+
+private:
+  /**
+   * Create an empty file next to `target`. Every run writes its own
+   * file, so concurrent runs for the same output do not interfere.
+   */
+  static auto create_temporary(const std::string& target) -> std::string {
+    std::string name = target + ".XXXXXX";
+    int fd = mkstemp(name.data());
+    if (fd < 0) {
+      throw std::runtime_error("cannot create temporary file for " + target);
+    }
+    // mkstemp only allows the owner to access the file, the output gets
+    // the usual permissions.
+    mode_t mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+    close(fd);
+    return name;
+  }
+
+  static auto same_content(const std::string& lhs, const std::string& rhs)
+      -> bool {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(lhs, ec);
+    if (ec || size != std::filesystem::file_size(rhs, ec) || ec) {
+      return false;
+    }
+
+    std::ifstream lhs_in{lhs, std::ios::binary};
+    std::ifstream rhs_in{rhs, std::ios::binary};
+    std::array<char, 1 << 16> lhs_buf{};
+    std::array<char, 1 << 16> rhs_buf{};
+    while (lhs_in && rhs_in) {
+      lhs_in.read(lhs_buf.data(), lhs_buf.size());
+      rhs_in.read(rhs_buf.data(), rhs_buf.size());
+      if (lhs_in.gcount() != rhs_in.gcount() ||
+          !std::equal(lhs_buf.begin(), lhs_buf.begin() + lhs_in.gcount(),
+                      rhs_buf.begin())) {
+        return false;
+      }
+    }
+    return lhs_in.eof() && rhs_in.eof();
+  }
+
+  std::optional<std::string> path;
+  std::string tmp_path;
+  std::optional<fmt::ostream> file;
+};
+
+/**
+ * Time to live of cached results per method, keyed by
+ * `interface.method`.
+ */
+using cache_config = std::unordered_map<std::string, std::chrono::milliseconds>;
+
+/**
+ * Annotation marking a method as cacheable in introspection data. The
+ * value is the time to live of results in milliseconds.
+ */
+constexpr auto cache_annotation = "org.offlrofl.Cache";
+
+/**
+ * Read a cache configuration file. Every line consists of the qualified
+ * name of a method and the time to live of its results in
+ * milliseconds, e.g. `org.freedesktop.ScreenSaver.GetActive 1000`.
+ * Empty lines and lines starting with '#' are ignored.
+ */
+auto read_cache_config(const std::string& file) -> cache_config {
+  std::ifstream in{file};
+  if (!in) {
+    throw std::runtime_error("cannot open " + file);
+  }
+
+  cache_config config;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields{line};
+    std::string method;
+    long long ttl = 0;
+    if (!(fields >> method) || method[0] == '#') {
+      continue;
+    }
+    if (!(fields >> ttl) || ttl <= 0) {
+      throw std::runtime_error("invalid cache configuration: " + line);
+    }
+    config.insert_or_assign(method, std::chrono::milliseconds{ttl});
+  }
+  return config;
+}
+
+/**
+ * Return the time to live of results of the given method or nothing if
+ * the method is not cacheable. The configuration file takes precedence
+ * over annotations.
+ */
+auto cache_ttl(const cache_config& config,
+               const std::string& interface_name,
+               const pugi::xml_node& method)
+    -> std::optional<std::chrono::milliseconds> {
+  auto it = config.find(interface_name + "." +
+                        method.attribute("name").value());
+  if (it != config.end()) {
+    return it->second;
+  }
+
+  auto annotation =
+      method.find_child_by_attribute("annotation", "name", cache_annotation);
+  if (annotation) {
+    auto ttl = std::strtoll(annotation.attribute("value").value(), nullptr, 10);
+    if (ttl > 0) {
+      return std::chrono::milliseconds{ttl};
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * Return whether the results of the method are cached. Methods without
+ * return value are never cached.
+ */
+auto is_cached(const cache_config& config,
+               const std::string& interface_name,
+               const pugi::xml_node& method) -> bool {
+  return cache_ttl(config, interface_name, method) &&
+         method.find_child_by_attribute("arg", "direction", "out");
+}
+
+/**
+ * Return whether the results of any method of the interface are cached.
+ */
+auto has_cached_methods(const cache_config& config,
+                        const pugi::xml_node& interface) -> bool {
+  std::string interface_name = interface.attribute("name").value();
+  for (auto method : interface.children("method")) {
+    if (is_cached(config, interface_name, method)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void replace(std::string& str, char needle, char with) {
   std::replace_if(
       std::begin(str), std::end(str), [needle](char c) { return c == needle; },
@@ -163,9 +413,12 @@ auto translate_arg_type(const std::string& arg) -> std::optional<std::string> {
 
 /**
  * Generate code for the synchronous function call for the method
- * specified by the given xml node.
+ * specified by the given xml node. Results of the call are cached for
+ * the given time if set.
  */
-auto generate_method_code(const pugi::xml_node& method) -> std::string {
+void generate_method_code(code_writer& out,
+                          const pugi::xml_node& method,
+                          std::optional<std::chrono::milliseconds> ttl) {
   std::string return_type;
   std::string arguments;
   std::string typed_arguments;
@@ -182,9 +435,10 @@ auto generate_method_code(const pugi::xml_node& method) -> std::string {
           "Unknown argument type '{}' for method '{}' argument '{}'. Skipping "
           "method.\n",
           arg_dbus_type, method_name, arg_name);
-      return fmt::format(
-          "  // {method} skipped. Argument type {type} unknown.\n",
-          fmt::arg("method", method_name), fmt::arg("type", arg_dbus_type));
+      out.print("  // {method} skipped. Argument type {type} unknown.\n",
+                fmt::arg("method", method_name),
+                fmt::arg("type", arg_dbus_type));
+      return;
     }
 
     const auto* arg_direction = arg.attribute("direction").value();
@@ -207,7 +461,9 @@ auto generate_method_code(const pugi::xml_node& method) -> std::string {
       if (!return_type.empty()) {
         fmt::print(stderr, "Found multiple return arguments in method '{}'",
                    method_name);
-        return fmt::format("  // {method} skipped. Multiple return values.\n");
+        out.print("  // {method} skipped. Multiple return values.\n",
+                  fmt::arg("method", method_name));
+        return;
       }
 
       return_type = *arg_type;
@@ -216,10 +472,11 @@ auto generate_method_code(const pugi::xml_node& method) -> std::string {
                  "Unknown argument direction '{}' for method '{}' "
                  "argument '{}'.",
                  arg_direction, method_name, arg_name);
-      return fmt::format(
+      out.print(
           "  // {method} skipped, unknown argument direction '{direction}'\n",
           fmt::arg("method", method_name),
           fmt::arg("direction", arg_direction));
+      return;
     }
   }
 
@@ -228,8 +485,28 @@ auto generate_method_code(const pugi::xml_node& method) -> std::string {
     return_type = "void";
   }
 
+  if (ttl && return_type == "void") {
+    fmt::print(stderr,
+               "Method '{}' has no return value and is not cached.\n",
+               method_name);
+    ttl.reset();
+  }
+
+  if (ttl) {
+    // clang-format off
+    out.print(
+        "  {return_type} {method}({typed_arguments}){{ return call_cached<{return_type}>(std::chrono::milliseconds{{{ttl}}}, \"{method}\"{arguments}); }}\n",
+        fmt::arg("return_type", return_type),
+        fmt::arg("method", method_name),
+        fmt::arg("typed_arguments", typed_arguments),
+        fmt::arg("ttl", ttl->count()),
+        fmt::arg("arguments", arguments));
+    // clang-format on
+    return;
+  }
+
   // clang-format off
-  return fmt::format(
+  out.print(
       "  {return_type} {method}({typed_arguments}){{ return call<{return_type}>(\"{method}\"{arguments}); }}\n",
 			fmt::arg("return_type", return_type),
 			fmt::arg("method", method_name),
@@ -238,66 +515,112 @@ auto generate_method_code(const pugi::xml_node& method) -> std::string {
   // clang-format on
 }
 
-auto generate_source_code(const std::string& interface_description,
+void generate_source_code(code_writer& out,
+                          const std::string& interface_description,
                           const std::string& destination,
-                          const std::string& path) -> std::string {
+                          const std::string& path,
+                          const cache_config& config) {
   pugi::xml_document doc;
-  pugi::xml_parse_result res = doc.load_string(interface_description.c_str());
+  pugi::xml_parse_result res = doc.load_buffer(interface_description.data(),
+                                               interface_description.size());
   if (!res) {
     throw res;
   }
 
-  std::string code = fmt::format(preamble, fmt::arg("name", destination));
+  auto interfaces = doc.child("node").children("interface");
+  bool any_cached = false;
+  for (auto interface : interfaces) {
+    any_cached = any_cached || has_cached_methods(config, interface);
+  }
+  out.print(preamble, fmt::arg("name", destination),
+            fmt::arg("cache_includes", any_cached ? cache_includes : ""));
 
-  for (auto interface : doc.child("node").children("interface")) {
+  for (auto interface : interfaces) {
     std::string interface_name = interface.attribute("name").value();
     fmt::print(stderr, "Generating interface for {}\n", interface_name);
 
     std::string class_name = interface_name;
     replace(class_name, '.', '_');
 
-    std::string methods;
+    out.print(class_header, fmt::arg("class", class_name));
     for (auto method : interface.children("method")) {
-      methods.append(generate_method_code(method));
+      generate_method_code(out, method,
+                           cache_ttl(config, interface_name, method));
     }
-
-    code += fmt::format(
-        class_template, fmt::arg("class", class_name),
-        fmt::arg("methods", methods), fmt::arg("destination", destination),
-        fmt::arg("path", path), fmt::arg("interface", interface_name));
+    bool cached = has_cached_methods(config, interface);
+    out.print(class_footer, fmt::arg("destination", destination),
+              fmt::arg("path", path), fmt::arg("interface", interface_name),
+              fmt::arg("cache_stats", cached ? cache_stats : ""),
+              fmt::arg("cache_member", cached ? cache_member : ""),
+              fmt::arg("call_cached", cached ? call_cached : ""));
   }
+}
 
-  return code;
+auto read_introspect_xml(const std::string& file) -> std::string {
+  std::ifstream in{file, std::ios::binary};
+  if (!in) {
+    throw std::runtime_error("cannot open " + file);
+  }
+  return std::string{std::istreambuf_iterator<char>{in},
+                     std::istreambuf_iterator<char>{}};
 }
 
 auto main(int argc, const char** argv) -> int {
   try {
-    if (argc < 2) {
+    std::optional<std::string> output;
+    std::optional<std::string> xml_file;
+    std::optional<std::string> cache_file;
+    const char* object = nullptr;
+    for (int i = 1; i < argc; ++i) {
+      if (argv[i] == "-o"sv && i + 1 < argc) {
+        output = argv[++i];
+      } else if (argv[i] == "--xml"sv && i + 1 < argc) {
+        xml_file = argv[++i];
+      } else if (argv[i] == "--cache-config"sv && i + 1 < argc) {
+        cache_file = argv[++i];
+      } else {
+        object = argv[i];
+      }
+    }
+
+    if (object == nullptr) {
       const auto* name = argc < 1 ? "generate_interface" : argv[0];
       fmt::print(stderr,
-                 "Usage: {} object-destination\n"
+                 "Usage: {} [-o output] [--xml file] [--cache-config file] "
+                 "object-destination\n"
                  "object-destination may either be a path or a destination. "
-                 "(Example: org.freedesktop.ScreenSaver)",
+                 "(Example: org.freedesktop.ScreenSaver)\n"
+                 "Without -o the code is written to stdout. With --xml the "
+                 "introspection data is read from the file instead of the "
+                 "session bus. --cache-config names a file listing methods "
+                 "whose results are cached, one 'interface.method ttl-ms' "
+                 "per line.\n",
                  name);
       return EXIT_FAILURE;
     }
 
-    std::string destination = argv[1];
+    std::string destination = object;
     replace(destination, '/', '.');
     if (!destination.empty() && destination[0] == '.') {
       destination.erase(0, 1);
     }
 
-    std::string path = argv[1];
+    std::string path = object;
     replace(path, '.', '/');
     if (!path.empty() && path[0] != '/') {
       path.insert(0, 1, '/');
     }
 
-    auto xml = retrieve_introspect_xml(destination, path);
-    auto code = generate_source_code(xml, destination, path);
+    auto xml = xml_file ? read_introspect_xml(*xml_file)
+                        : retrieve_introspect_xml(destination, path);
+
+    auto config = cache_file ? read_cache_config(*cache_file) : cache_config{};
 
-    fmt::print("{}", code);
+    code_writer out{output};
+    generate_source_code(out, xml, destination, path, config);
+    if (!out.commit()) {
+      fmt::print(stderr, "{} is up to date\n", *output);
+    }
 
     return EXIT_SUCCESS;
   } catch (const std::exception& e) {
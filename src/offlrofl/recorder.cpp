@@ -0,0 +1,321 @@
+#include <offlrofl/recorder.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+#include <dbus/dbus.h>
+}
+
+namespace {
+using offlrofl::recorder;
+
+constexpr char magic[8] = {'O', 'F', 'L', 'R', 'R', 'E', 'C', '\0'};
+constexpr uint32_t version = 2;
+
+static_assert(sizeof(recorder::file_header) <= recorder::data_offset);
+static_assert(sizeof(recorder::record_header) % 8 == 0);
+
+constexpr auto align(uint64_t size) -> uint64_t {
+  return (size + 7U) & ~uint64_t{7U};
+}
+
+/**
+ * Return the number of bytes occupied by the record at `pos` including
+ * any space skipped after it, or 0 if the record claims to extend past
+ * the end of the data area.
+ */
+auto record_length(const char* data, uint64_t capacity, uint64_t pos)
+    -> uint64_t {
+  uint64_t offset = pos % capacity;
+  uint64_t contiguous = capacity - offset;
+  if (contiguous < sizeof(recorder::record_header)) {
+    // Too small to hold a header, the writer skipped it.
+    return contiguous;
+  }
+
+  recorder::record_header rec{};
+  std::memcpy(&rec, data + offset, sizeof(rec));
+  uint64_t length = align(sizeof(rec) + rec.size);
+  return length <= contiguous ? length : 0;
+}
+
+/**
+ * Thrown if the recording is locked by another recorder.
+ */
+class recording_in_use : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+auto expand_path(const std::string& path) -> std::string {
+  std::string result = path;
+  auto pid = std::to_string(getpid());
+  for (auto pos = result.find("%p"); pos != std::string::npos;
+       pos = result.find("%p", pos + pid.size())) {
+    result.replace(pos, 2, pid);
+  }
+  return result;
+}
+
+/**
+ * Return whether the file is empty or starts like a recording, i.e. may
+ * be resized and overwritten.
+ */
+auto is_recording_or_empty(int fd) -> bool {
+  struct stat st {};
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+  if (st.st_size == 0) {
+    return true;
+  }
+
+  char file_magic[sizeof(magic)] = {};
+  return pread(fd, file_magic, sizeof(file_magic), 0) ==
+             static_cast<ssize_t>(sizeof(file_magic)) &&
+         std::memcmp(file_magic, magic, sizeof(magic)) == 0;
+}
+}
+
+namespace offlrofl {
+recorder::recorder(const std::string& path, std::size_t capacity) {
+  capacity = align(capacity);
+  if (capacity < sizeof(record_header)) {
+    throw std::runtime_error("recording capacity too small");
+  }
+
+  auto file = expand_path(path);
+  fd = open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    throw std::runtime_error("cannot open recording " + file);
+  }
+  // Two writers would overwrite each other's records and positions.
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    bool locked = errno == EWOULDBLOCK;
+    close(fd);
+    if (locked) {
+      throw recording_in_use("recording " + file + " is in use");
+    }
+    throw std::runtime_error("cannot lock recording " + file);
+  }
+  // Never clobber a file that was not created by a recorder.
+  if (!is_recording_or_empty(fd)) {
+    close(fd);
+    throw std::runtime_error(file + " is not a recording");
+  }
+
+  mapped_size = data_offset + capacity;
+  void* mem = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(mapped_size)) == 0) {
+    mem = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+               0);
+  }
+  if (mem == MAP_FAILED) {
+    close(fd);
+    throw std::runtime_error("cannot map recording " + file);
+  }
+
+  header = static_cast<file_header*>(mem);
+  data = static_cast<char*>(mem) + data_offset;
+
+  if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 ||
+      header->version != version || header->capacity != capacity ||
+      header->head < header->tail || header->head - header->tail > capacity ||
+      header->head % 8 != 0 || header->tail % 8 != 0) {
+    std::memset(header, 0, data_offset);
+    std::memcpy(header->magic, magic, sizeof(magic));
+    header->version = version;
+    header->capacity = capacity;
+  }
+}
+
+recorder::~recorder() {
+  munmap(header, mapped_size);
+  // Closing the file releases the lock.
+  close(fd);
+}
+
+auto recorder::from_environment() -> std::shared_ptr<recorder> {
+  static const std::shared_ptr<recorder> instance =
+      []() -> std::shared_ptr<recorder> {
+    const char* path = std::getenv("OFFLROFL_RECORD");
+    if (path == nullptr || *path == '\0') {
+      return nullptr;
+    }
+
+    std::size_t capacity = default_capacity;
+    if (const char* size = std::getenv("OFFLROFL_RECORD_SIZE");
+        size != nullptr) {
+      auto parsed = std::strtoull(size, nullptr, 10);
+      if (parsed != 0) {
+        capacity = parsed;
+      }
+    }
+
+    // Recording is a debugging aid and must not break the caller.
+    try {
+      try {
+        return std::make_shared<recorder>(path, capacity);
+      } catch (const recording_in_use&) {
+        // Another process is already recording to the file.
+        return std::make_shared<recorder>(
+            expand_path(path) + "." + std::to_string(getpid()), capacity);
+      }
+    } catch (const std::exception&) {
+      return nullptr;
+    }
+  }();
+  return instance;
+}
+
+auto recorder::now() -> timestamp {
+  auto nanoseconds = [](auto duration) -> uint64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+        .count();
+  };
+  return {nanoseconds(std::chrono::system_clock::now().time_since_epoch()),
+          nanoseconds(std::chrono::steady_clock::now().time_since_epoch())};
+}
+
+void recorder::append(record_kind kind,
+                      uint32_t serial,
+                      timestamp time,
+                      DBusMessage* msg) {
+  char* marshalled = nullptr;
+  int size = 0;
+  if (dbus_message_marshal(msg, &marshalled, &size) == FALSE) {
+    return;
+  }
+
+  append(kind, serial, time, marshalled, static_cast<std::size_t>(size));
+  dbus_free(marshalled);
+}
+
+void recorder::append(uint32_t serial,
+                      timestamp time,
+                      const DBusError* err) {
+  std::string payload = err->name != nullptr ? err->name : "";
+  payload.push_back('\0');
+  payload.append(err->message != nullptr ? err->message : "");
+
+  append(record_kind::error, serial, time, payload.data(),
+         payload.size());
+}
+
+void recorder::append(record_kind kind,
+                      uint32_t serial,
+                      timestamp time,
+                      const char* bytes,
+                      std::size_t size) {
+  uint64_t needed = align(sizeof(record_header) + size);
+  if (needed > header->capacity) {
+    return;
+  }
+
+  std::lock_guard lock{mutex};
+
+  uint64_t capacity = header->capacity;
+  uint64_t head = header->head;
+  uint64_t contiguous = capacity - head % capacity;
+  if (contiguous < needed) {
+    // Records never wrap, so skip the rest of the data area.
+    make_room(head, contiguous);
+    if (contiguous >= sizeof(record_header)) {
+      record_header padding{};
+      padding.size = static_cast<uint32_t>(contiguous - sizeof(padding));
+      padding.kind = record_kind::padding;
+      std::memcpy(data + head % capacity, &padding, sizeof(padding));
+    }
+    head += contiguous;
+    header->head = head;
+  }
+
+  make_room(head, needed);
+
+  record_header rec{};
+  rec.size = static_cast<uint32_t>(size);
+  rec.kind = kind;
+  rec.serial = serial;
+  rec.time = time;
+  char* dest = data + head % capacity;
+  std::memcpy(dest, &rec, sizeof(rec));
+  std::memcpy(dest + sizeof(rec), bytes, size);
+
+  header->head = head + needed;
+}
+
+void recorder::make_room(uint64_t head, std::size_t size) {
+  // Drop the oldest records until the new one fits. The tail is moved
+  // before they are overwritten, so a reader never sees a partially
+  // overwritten record.
+  while (head + size - header->tail > header->capacity) {
+    uint64_t length = record_length(data, header->capacity, header->tail);
+    if (length == 0 || length > head - header->tail) {
+      // The records are corrupt, e.g. because the file was modified
+      // behind our back. Drop all of them.
+      header->tail = head;
+      return;
+    }
+    header->tail += length;
+  }
+}
+
+auto recorder::read(const std::string& path) -> std::vector<record> {
+  std::ifstream in{path, std::ios::binary};
+  if (!in) {
+    throw std::runtime_error("cannot open recording " + path);
+  }
+  std::vector<char> file{std::istreambuf_iterator<char>{in},
+                         std::istreambuf_iterator<char>{}};
+
+  file_header hdr{};
+  if (file.size() < data_offset) {
+    throw std::runtime_error("invalid recording");
+  }
+  std::memcpy(&hdr, file.data(), sizeof(hdr));
+  if (std::memcmp(hdr.magic, magic, sizeof(magic)) != 0 ||
+      hdr.version != version || hdr.capacity == 0 ||
+      file.size() < data_offset + hdr.capacity || hdr.head < hdr.tail ||
+      hdr.head - hdr.tail > hdr.capacity || hdr.tail % 8 != 0) {
+    throw std::runtime_error("invalid recording");
+  }
+
+  const char* bytes = file.data() + data_offset;
+  std::vector<record> records;
+  uint64_t length = 0;
+  for (uint64_t pos = hdr.tail; pos < hdr.head; pos += length) {
+    length = record_length(bytes, hdr.capacity, pos);
+    if (length == 0 || length > hdr.head - pos) {
+      throw std::runtime_error("corrupt record in recording");
+    }
+
+    uint64_t offset = pos % hdr.capacity;
+    if (hdr.capacity - offset < sizeof(record_header)) {
+      continue;
+    }
+
+    record_header rec{};
+    std::memcpy(&rec, bytes + offset, sizeof(rec));
+    if (rec.kind == record_kind::padding) {
+      continue;
+    }
+
+    const char* payload = bytes + offset + sizeof(rec);
+    records.push_back(record{rec.kind, rec.serial, rec.time,
+                             {payload, payload + rec.size}});
+  }
+  return records;
+}
+}
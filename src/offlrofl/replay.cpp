@@ -0,0 +1,292 @@
+#include <offlrofl/connection.h>
+#include <offlrofl/error.h>
+#include <offlrofl/message.h>
+#include <offlrofl/recorder.h>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <dbus/dbus.h>
+}
+
+// Replays a recording made through OFFLROFL_RECORD. The recorded calls
+// are sent again with their original spacing and answered by a mock
+// service that owns the recorded destinations and sends back the
+// recorded replies after the recorded latency. This reproduces the
+// traffic of a customer machine on a local (ideally private) bus.
+
+using namespace std::string_view_literals;
+using offlrofl::recorder;
+
+namespace {
+constexpr std::string_view bus_name = DBUS_SERVICE_DBUS;
+
+/**
+ * Return the time that passed between two records. Records of different
+ * processes are only comparable if they were made during the same boot,
+ * otherwise the time is reported as zero.
+ */
+auto elapsed(const recorder::record& from, const recorder::record& to)
+    -> std::chrono::nanoseconds {
+  if (to.time.monotonic < from.time.monotonic) {
+    return std::chrono::nanoseconds{0};
+  }
+  return std::chrono::nanoseconds{to.time.monotonic - from.time.monotonic};
+}
+
+/**
+ * A recorded call together with its reply.
+ */
+struct exchange {
+  const recorder::record* call;
+  const recorder::record* reply;
+
+  [[nodiscard]] auto latency() const -> std::chrono::nanoseconds {
+    return elapsed(*call, *reply);
+  }
+};
+
+auto demarshal(const recorder::record& rec) -> offlrofl::message {
+  offlrofl::error err;
+  auto* raw = dbus_message_demarshal(rec.data.data(),
+                                     static_cast<int>(rec.data.size()), err);
+  err.throw_if_error();
+
+  // Copies have no serial, so they get a fresh one when sent.
+  auto original = offlrofl::message::wrap(raw);
+  return offlrofl::message::wrap(dbus_message_copy(original));
+}
+
+/**
+ * Pair every recorded call with its reply. Calls whose reply is not
+ * part of the recording are dropped.
+ */
+auto pair_exchanges(const std::vector<recorder::record>& records)
+    -> std::vector<exchange> {
+  std::vector<exchange> exchanges;
+  for (auto call = records.begin(); call != records.end(); ++call) {
+    if (call->kind != recorder::record_kind::call) {
+      continue;
+    }
+
+    auto reply = std::find_if(call + 1, records.end(), [&call](const auto& r) {
+      return r.kind != recorder::record_kind::call && r.serial == call->serial;
+    });
+    if (reply != records.end()) {
+      exchanges.push_back({&*call, &*reply});
+    }
+  }
+  return exchanges;
+}
+
+/**
+ * Answers replayed calls with the recorded replies. Calls are made one
+ * at a time, so the service only ever has to answer a single pending
+ * exchange.
+ */
+class mock_service {
+public:
+  mock_service(const std::set<std::string>& names, bool init_delay)
+      : delay{init_delay} {
+    offlrofl::error err;
+    conn = dbus_bus_get_private(DBUS_BUS_SESSION, err);
+    err.throw_if_error();
+
+    for (const auto& name : names) {
+      int res = dbus_bus_request_name(conn, name.c_str(),
+                                      DBUS_NAME_FLAG_DO_NOT_QUEUE, err);
+      if (err.is_error() || res != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+        dbus_connection_close(conn);
+        dbus_connection_unref(conn);
+        throw std::runtime_error(
+            fmt::format("cannot acquire {}, run the replay under "
+                        "dbus-run-session",
+                        name));
+      }
+    }
+
+    worker = std::thread{[this] { run(); }};
+  }
+
+  mock_service(const mock_service&) = delete;
+  mock_service(mock_service&&) = delete;
+  auto operator=(const mock_service&) -> mock_service& = delete;
+  auto operator=(mock_service&&) -> mock_service& = delete;
+
+  ~mock_service() {
+    stop.store(true);
+    worker.join();
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+  }
+
+  /**
+   * Set the exchange the next incoming call is answered with.
+   */
+  void expect(const exchange& next) {
+    std::lock_guard lock{mutex};
+    pending = next;
+  }
+
+private:
+  void run() {
+    constexpr int poll_timeout_ms = 10;
+    while (!stop.load() && dbus_connection_read_write(conn, poll_timeout_ms)) {
+      while (auto* raw = dbus_connection_pop_message(conn)) {
+        auto msg = offlrofl::message::wrap(raw);
+        if (dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_METHOD_CALL) {
+          answer(msg);
+        }
+      }
+    }
+  }
+
+  void answer(offlrofl::message& msg) {
+    std::optional<exchange> current;
+    {
+      std::lock_guard lock{mutex};
+      std::swap(current, pending);
+    }
+    if (!current) {
+      auto reply = offlrofl::message::wrap(dbus_message_new_error(
+          msg, DBUS_ERROR_FAILED, "call not part of the recording"));
+      dbus_connection_send(conn, reply, nullptr);
+      return;
+    }
+
+    if (delay) {
+      std::this_thread::sleep_for(current->latency());
+    }
+
+    const auto& rec = *current->reply;
+    if (rec.kind == recorder::record_kind::error) {
+      // Error name and message are separated by a null character.
+      const char* name = rec.data.data();
+      const char* text = name + std::strlen(name) + 1;
+      auto reply =
+          offlrofl::message::wrap(dbus_message_new_error(msg, name, text));
+      dbus_connection_send(conn, reply, nullptr);
+    } else {
+      auto reply = demarshal(rec);
+      dbus_message_set_reply_serial(reply, dbus_message_get_serial(msg));
+      dbus_message_set_destination(reply, dbus_message_get_sender(msg));
+      dbus_connection_send(conn, reply, nullptr);
+    }
+    dbus_connection_flush(conn);
+  }
+
+  DBusConnection* conn = nullptr;
+  bool delay;
+  std::mutex mutex;
+  std::optional<exchange> pending;
+  std::atomic<bool> stop{false};
+  std::thread worker;
+};
+}
+
+auto main(int argc, const char** argv) -> int {
+  try {
+    bool delay = true;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+      if (argv[i] == "--no-delay"sv) {
+        delay = false;
+      } else {
+        path = argv[i];
+      }
+    }
+    if (path == nullptr) {
+      const auto* name = argc < 1 ? "replay" : argv[0];
+      fmt::print(stderr,
+                 "Usage: {} [--no-delay] recording\n"
+                 "Replays a recording made by setting OFFLROFL_RECORD. "
+                 "With --no-delay calls are sent back to back and "
+                 "answered immediately.\n",
+                 name);
+      return EXIT_FAILURE;
+    }
+
+    auto records = recorder::read(path);
+    auto exchanges = pair_exchanges(records);
+
+    // Calls to the bus itself are answered by the bus, everything else
+    // by the mock service.
+    std::vector<std::pair<exchange, offlrofl::message>> calls;
+    std::set<std::string> names;
+    for (const auto& ex : exchanges) {
+      auto msg = demarshal(*ex.call);
+      const char* destination = dbus_message_get_destination(msg);
+      if (destination == nullptr || destination[0] == ':') {
+        fmt::print(stderr,
+                   "Skipping call to {} without well-known destination\n",
+                   dbus_message_get_member(msg));
+        continue;
+      }
+      if (destination != bus_name) {
+        names.insert(destination);
+      }
+      calls.emplace_back(ex, std::move(msg));
+    }
+
+    mock_service service{names, delay};
+    auto conn = offlrofl::connection::session();
+
+    std::chrono::nanoseconds recorded_total{0};
+    std::chrono::nanoseconds replayed_total{0};
+    auto start = std::chrono::steady_clock::now();
+    for (auto& [ex, msg] : calls) {
+      if (delay) {
+        auto offset = elapsed(*calls.front().first.call, *ex.call);
+        std::this_thread::sleep_until(start + offset);
+      }
+
+      if (dbus_message_get_destination(msg) != bus_name) {
+        service.expect(ex);
+      }
+
+      auto sent = std::chrono::steady_clock::now();
+      std::string outcome = "ok";
+      try {
+        conn.send_with_reply(msg);
+      } catch (const std::exception& e) {
+        outcome = e.what();
+      }
+      auto replayed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - sent);
+
+      recorded_total += ex.latency();
+      replayed_total += replayed;
+      const char* iface = dbus_message_get_interface(msg);
+      fmt::print("{:>8} {}.{} recorded {:>10} ns replayed {:>10} ns: {}\n",
+                 ex.call->serial, iface != nullptr ? iface : "",
+                 dbus_message_get_member(msg), ex.latency().count(),
+                 replayed.count(), outcome);
+    }
+
+    if (!calls.empty()) {
+      auto count = static_cast<int64_t>(calls.size());
+      fmt::print("{} calls, mean latency recorded {} ns replayed {} ns\n",
+                 count, recorded_total.count() / count,
+                 replayed_total.count() / count);
+    }
+
+    return EXIT_SUCCESS;
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "Unknown error: {}\n", e.what());
+  }
+  return EXIT_FAILURE;
+}
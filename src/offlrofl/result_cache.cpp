@@ -0,0 +1,152 @@
+#include <offlrofl/error.h>
+#include <offlrofl/result_cache.h>
+
+#include <algorithm>
+#include <new>
+#include <string>
+#include <utility>
+
+extern "C" {
+#include <dbus/dbus.h>
+}
+
+namespace offlrofl {
+/**
+ * Counts changes of the owner of a bus name by listening for
+ * NameOwnerChanged signals. There is no main loop dispatching the
+ * connection, so pending signals are only processed when polled.
+ */
+class result_cache::owner_watch {
+public:
+  owner_watch(DBusConnection* init_conn, const char* name)
+      : conn{init_conn}, bus_name{name} {
+    rule = "type='signal',sender='" DBUS_SERVICE_DBUS
+           "',interface='" DBUS_INTERFACE_DBUS
+           "',member='NameOwnerChanged',arg0='";
+    rule.append(bus_name).append("'");
+
+    if (dbus_connection_add_filter(conn, &owner_watch::filter, this,
+                                   nullptr) == FALSE) {
+      throw std::bad_alloc();
+    }
+
+    error err;
+    dbus_bus_add_match(conn, rule.c_str(), err);
+    if (err.is_error()) {
+      dbus_connection_remove_filter(conn, &owner_watch::filter, this);
+      err.throw_if_error();
+    }
+  }
+
+  owner_watch(const owner_watch&) = delete;
+  owner_watch(owner_watch&&) = delete;
+  auto operator=(const owner_watch&) -> owner_watch& = delete;
+  auto operator=(owner_watch&&) -> owner_watch& = delete;
+
+  ~owner_watch() {
+    // Passing no error makes the call asynchronous.
+    dbus_bus_remove_match(conn, rule.c_str(), nullptr);
+    dbus_connection_remove_filter(conn, &owner_watch::filter, this);
+  }
+
+  /**
+   * Process pending signals without blocking and return the number of
+   * owner changes seen so far.
+   */
+  auto poll() -> uint64_t {
+    dbus_connection_read_write(conn, 0);
+    while (dbus_connection_dispatch(conn) == DBUS_DISPATCH_DATA_REMAINS) {
+    }
+    return generation;
+  }
+
+private:
+  static auto filter(DBusConnection* /*conn*/, DBusMessage* msg, void* data)
+      -> DBusHandlerResult {
+    auto* self = static_cast<owner_watch*>(data);
+    if (dbus_message_is_signal(msg, DBUS_INTERFACE_DBUS, "NameOwnerChanged") !=
+        FALSE) {
+      const char* name = nullptr;
+      const char* old_owner = nullptr;
+      const char* new_owner = nullptr;
+      if (dbus_message_get_args(msg, nullptr, DBUS_TYPE_STRING, &name,
+                                DBUS_TYPE_STRING, &old_owner, DBUS_TYPE_STRING,
+                                &new_owner, DBUS_TYPE_INVALID) != FALSE &&
+          self->bus_name == name) {
+        ++self->generation;
+      }
+    }
+    // Other filters may be interested in the signal as well.
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+
+  DBusConnection* conn;
+  std::string bus_name;
+  std::string rule;
+  uint64_t generation = 0;
+};
+
+result_cache::result_cache() = default;
+
+result_cache::result_cache(result_cache&&) noexcept = default;
+
+auto result_cache::operator=(result_cache&&) noexcept
+    -> result_cache& = default;
+
+result_cache::~result_cache() = default;
+
+auto result_cache::find(connection& conn,
+                        const char* destination,
+                        const std::string& key) -> const entry* {
+  if (watch == nullptr) {
+    watch = std::make_unique<owner_watch>(conn, destination);
+    // Signals already queued on a shared connection describe changes
+    // before the watch started. The cache is empty anyway.
+    generation = watch->poll();
+  }
+
+  auto current = watch->poll();
+  if (current != generation) {
+    generation = current;
+    entries.clear();
+    earliest_expiry = clock::time_point::max();
+    ++counters.invalidations;
+  }
+
+  prune(clock::now());
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    ++counters.misses;
+    return nullptr;
+  }
+
+  ++counters.hits;
+  return &it->second;
+}
+
+void result_cache::insert(const std::string& key,
+                          value result,
+                          std::chrono::milliseconds ttl) {
+  auto now = clock::now();
+  prune(now);
+  auto expires = now + ttl;
+  entries.insert_or_assign(key, entry{std::move(result), expires});
+  earliest_expiry = std::min(earliest_expiry, expires);
+}
+
+void result_cache::prune(clock::time_point now) {
+  if (earliest_expiry > now) {
+    return;
+  }
+
+  earliest_expiry = clock::time_point::max();
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (it->second.expires <= now) {
+      it = entries.erase(it);
+    } else {
+      earliest_expiry = std::min(earliest_expiry, it->second.expires);
+      ++it;
+    }
+  }
+}
+}
@@ -0,0 +1,244 @@
+#include <mock_service.h>
+#include <test.h>
+
+#include <offlrofl/dynamic_proxy.h>
+
+#include <fmt/format.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+extern "C" {
+#include <dbus/dbus.h>
+}
+
+// Checks the method table, the argument checks and the introspection
+// cache of dynamic_proxy against a mock service. Must be run on a bus
+// of its own, the test target runs it under dbus-run-session.
+
+using offlrofl::dynamic_proxy;
+using test::check;
+using test::throws;
+
+namespace {
+constexpr auto service = "org.offlrofl.Test";
+constexpr auto object = "/org/offlrofl/Test";
+constexpr auto iface = "org.offlrofl.Test";
+
+constexpr auto introspection = R"(<node>
+  <interface name="org.offlrofl.Test">
+    <method name="Add">
+      <arg name="a" type="i" direction="in"/>
+      <arg name="b" type="i" direction="in"/>
+      <arg name="sum" type="i" direction="out"/>
+    </method>
+    <method name="Not">
+      <arg name="value" type="b" direction="in"/>
+      <arg name="negated" type="b" direction="out"/>
+    </method>
+    <method name="Echo">
+      <arg name="text" type="s"/>
+      <arg name="echo" type="s" direction="out"/>
+    </method>
+    <method name="GetAll">
+      <arg name="values" type="a{sv}" direction="out"/>
+    </method>
+    <method name="Split">
+      <arg name="text" type="s" direction="in"/>
+      <arg name="head" type="s" direction="out"/>
+      <arg name="tail" type="s" direction="out"/>
+    </method>
+  </interface>
+</node>)";
+
+/**
+ * Test service implementing the introspected interface. Counts how
+ * often it was introspected.
+ */
+class test_service {
+public:
+  test_service()
+      : service_impl{service, [this](auto* msg) { return answer(msg); }} {}
+
+  std::atomic<uint64_t> introspections{0};
+
+private:
+  auto answer(DBusMessage* msg) -> DBusMessage* {
+    if (dbus_message_is_method_call(msg, DBUS_INTERFACE_INTROSPECTABLE,
+                                    "Introspect") != FALSE) {
+      ++introspections;
+      auto* reply = dbus_message_new_method_return(msg);
+      const char* xml = introspection;
+      dbus_message_append_args(reply, DBUS_TYPE_STRING, &xml,
+                               DBUS_TYPE_INVALID);
+      return reply;
+    }
+
+    if (dbus_message_is_method_call(msg, iface, "Add") != FALSE) {
+      int32_t a = 0;
+      int32_t b = 0;
+      dbus_message_get_args(msg, nullptr, DBUS_TYPE_INT32, &a,
+                            DBUS_TYPE_INT32, &b, DBUS_TYPE_INVALID);
+      int32_t sum = a + b;
+      auto* reply = dbus_message_new_method_return(msg);
+      dbus_message_append_args(reply, DBUS_TYPE_INT32, &sum,
+                               DBUS_TYPE_INVALID);
+      return reply;
+    }
+
+    if (dbus_message_is_method_call(msg, iface, "Not") != FALSE) {
+      dbus_bool_t value = FALSE;
+      dbus_message_get_args(msg, nullptr, DBUS_TYPE_BOOLEAN, &value,
+                            DBUS_TYPE_INVALID);
+      dbus_bool_t negated = value != FALSE ? FALSE : TRUE;
+      auto* reply = dbus_message_new_method_return(msg);
+      dbus_message_append_args(reply, DBUS_TYPE_BOOLEAN, &negated,
+                               DBUS_TYPE_INVALID);
+      return reply;
+    }
+
+    if (dbus_message_is_method_call(msg, iface, "Echo") != FALSE) {
+      const char* text = "";
+      dbus_message_get_args(msg, nullptr, DBUS_TYPE_STRING, &text,
+                            DBUS_TYPE_INVALID);
+      auto* reply = dbus_message_new_method_return(msg);
+      dbus_message_append_args(reply, DBUS_TYPE_STRING, &text,
+                               DBUS_TYPE_INVALID);
+      return reply;
+    }
+
+    return nullptr;
+  }
+
+  mock_service service_impl;
+};
+
+/**
+ * Point the introspection cache at an empty directory of its own.
+ */
+auto use_cache_directory(const std::filesystem::path& dir)
+    -> std::filesystem::path {
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  setenv("XDG_CACHE_HOME", dir.c_str(), 1);
+  return dir / "offlrofl";
+}
+
+auto cache_files(const std::filesystem::path& dir)
+    -> std::vector<std::filesystem::path> {
+  std::vector<std::filesystem::path> files;
+  for (const auto& entry : std::filesystem::directory_iterator{dir}) {
+    files.push_back(entry.path());
+  }
+  return files;
+}
+
+void method_table(const std::filesystem::path& base) {
+  use_cache_directory(base / __func__);
+  test_service svc;
+  dynamic_proxy proxy{service, object, iface};
+
+  const auto* add = proxy.find_method("Add");
+  check(add != nullptr, __func__, "Add is supported");
+  check(add != nullptr && add->in_signature == "ii" && add->out_type == 'i',
+        __func__, "signature of Add");
+
+  const auto* echo = proxy.find_method("Echo");
+  check(echo != nullptr && echo->in_signature == "s", __func__,
+        "arguments default to 'in'");
+
+  check(proxy.find_method("GetAll") == nullptr, __func__,
+        "container types are rejected");
+  check(proxy.find_method("Split") == nullptr, __func__,
+        "multiple return values are rejected");
+  check(proxy.find_method("Missing") == nullptr, __func__,
+        "unknown methods are not found");
+}
+
+void argument_checks(const std::filesystem::path& base) {
+  use_cache_directory(base / __func__);
+  test_service svc;
+  dynamic_proxy proxy{service, object, iface};
+
+  check(throws([&] { proxy.call("Missing", {}); }), __func__,
+        "unknown method throws");
+  check(throws([&] { proxy.call("Add", {int32_t{1}}); }), __func__,
+        "too few arguments throw");
+  check(throws([&] {
+          proxy.call("Add", {int32_t{1}, int32_t{2}, int32_t{3}});
+        }),
+        __func__, "too many arguments throw");
+  check(throws([&] { proxy.call("Add", {int32_t{1}, uint32_t{2}}); }),
+        __func__, "wrong argument type throws");
+  check(throws([&] { proxy.call("Echo", {int32_t{1}}); }), __func__,
+        "integer for string throws");
+
+  check(proxy.call("Add", {int32_t{2}, int32_t{3}}) ==
+            dynamic_proxy::result{int32_t{5}},
+        __func__, "Add returns the sum");
+  check(proxy.call("Not", {true}) == dynamic_proxy::result{false}, __func__,
+        "booleans are passed both ways");
+  check(proxy.call("Echo", {"text"}) ==
+            dynamic_proxy::result{std::string{"text"}},
+        __func__, "strings are passed both ways");
+}
+
+void introspection_cache(const std::filesystem::path& base) {
+  auto dir = use_cache_directory(base / __func__);
+  {
+    test_service svc;
+    dynamic_proxy first{service, object, iface};
+    dynamic_proxy second{service, object, iface};
+    check(svc.introspections.load() == 1, __func__,
+          "second proxy is created from the cache");
+
+    auto files = cache_files(dir);
+    check(files.size() == 1, __func__, "a single cache file");
+    if (files.size() == 1) {
+      std::ofstream{files[0], std::ios::trunc} << "<node><interface";
+    }
+    dynamic_proxy repaired{service, object, iface};
+    check(svc.introspections.load() == 2, __func__,
+          "corrupt cache file is introspected again");
+    check(repaired.find_method("Add") != nullptr, __func__,
+          "proxy from corrupt cache file works");
+
+    dynamic_proxy cached{service, object, iface};
+    check(svc.introspections.load() == 2, __func__,
+          "corrupt cache file is replaced");
+  }
+
+  // A new instance of the service has a new unique name.
+  test_service restarted;
+  dynamic_proxy proxy{service, object, iface};
+  check(restarted.introspections.load() == 1, __func__,
+        "restarted service is introspected again");
+  check(cache_files(dir).size() == 1, __func__,
+        "files of earlier owners are removed");
+}
+}
+
+auto main() -> int {
+  try {
+    auto base = std::filesystem::temp_directory_path() /
+                fmt::format("offlrofl-test-{}", getpid());
+    method_table(base);
+    argument_checks(base);
+    introspection_cache(base);
+    std::filesystem::remove_all(base);
+
+    return test::exit_status();
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "Unknown error: {}\n", e.what());
+  }
+  return EXIT_FAILURE;
+}
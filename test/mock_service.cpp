@@ -0,0 +1,61 @@
+#include <mock_service.h>
+
+#include <offlrofl/error.h>
+#include <offlrofl/message.h>
+
+#include <stdexcept>
+#include <utility>
+
+extern "C" {
+#include <dbus/dbus.h>
+}
+
+namespace {
+constexpr int poll_timeout_ms = 10;
+}
+
+mock_service::mock_service(const char* name, handler init_handler)
+    : handle_call{std::move(init_handler)} {
+  offlrofl::error err;
+  conn = dbus_bus_get_private(DBUS_BUS_SESSION, err);
+  err.throw_if_error();
+
+  int res = dbus_bus_request_name(conn, name, DBUS_NAME_FLAG_DO_NOT_QUEUE, err);
+  if (err.is_error() || res != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+    throw std::runtime_error(std::string{"cannot acquire "} + name +
+                             ", run the test under dbus-run-session");
+  }
+  unique_name = dbus_bus_get_unique_name(conn);
+
+  worker = std::thread{[this] { run(); }};
+}
+
+mock_service::~mock_service() {
+  stop.store(true);
+  worker.join();
+  // Closing the connection releases the name.
+  dbus_connection_close(conn);
+  dbus_connection_unref(conn);
+}
+
+void mock_service::run() {
+  while (!stop.load() && dbus_connection_read_write(conn, poll_timeout_ms)) {
+    while (auto* raw = dbus_connection_pop_message(conn)) {
+      auto msg = offlrofl::message::wrap(raw);
+      if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_METHOD_CALL) {
+        continue;
+      }
+
+      auto* reply = handle_call(msg);
+      if (reply == nullptr) {
+        reply = dbus_message_new_error(msg, DBUS_ERROR_UNKNOWN_METHOD,
+                                       "unknown method");
+      }
+      auto wrapped = offlrofl::message::wrap(reply);
+      dbus_connection_send(conn, wrapped, nullptr);
+      dbus_connection_flush(conn);
+    }
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+struct DBusConnection;
+struct DBusMessage;
+
+/**
+ * Service owning a bus name on its own session bus connection. Method
+ * calls are answered on a worker thread by a handler, calls it does not
+ * answer get an UnknownMethod error. Every instance has a new unique
+ * name, so destroying a service and creating another one looks like a
+ * restart to clients.
+ */
+class mock_service {
+public:
+  /**
+   * Return the reply to a method call or nullptr if the method is not
+   * known. Ownership of the reply is passed to the service.
+   */
+  using handler = std::function<DBusMessage*(DBusMessage* call)>;
+
+  /**
+   * Acquire `name` and start answering calls.
+   * @throws std::runtime_error if the name cannot be acquired.
+   */
+  mock_service(const char* name, handler init_handler);
+
+  mock_service(const mock_service&) = delete;
+  auto operator=(const mock_service&) -> mock_service& = delete;
+  mock_service(mock_service&&) = delete;
+  auto operator=(mock_service&&) -> mock_service& = delete;
+
+  ~mock_service();
+
+  [[nodiscard]] auto get_unique_name() const -> const std::string& {
+    return unique_name;
+  }
+
+private:
+  void run();
+
+  DBusConnection* conn = nullptr;
+  handler handle_call;
+  std::string unique_name;
+  std::atomic<bool> stop{false};
+  std::thread worker;
+};
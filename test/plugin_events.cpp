@@ -0,0 +1,265 @@
+#include <mock_screensaver.h>
+#include <mpv_shim.h>
+#include <test.h>
+
+#include <offlrofl/connection.h>
+#include <offlrofl/message.h>
+
+#include <fmt/format.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <thread>
+#include <vector>
+
+// Checks the D-Bus calls the plugin makes for scripted event streams.
+// Must be run on a bus where org.freedesktop.ScreenSaver is free, the
+// test target runs it under dbus-run-session.
+
+using mpv_shim::file_loaded;
+using mpv_shim::pause_event;
+using mpv_shim::plugin_entry;
+using mpv_shim::scripted_event;
+using test::check;
+
+namespace {
+constexpr std::size_t events = 1000;
+
+struct run_result {
+  int status;
+  uint64_t inhibits;
+  uint64_t uninhibits;
+};
+
+auto run(plugin_entry open_plugin,
+         mock_screensaver& screensaver,
+         std::vector<scripted_event> script,
+         const char* script_opts = "") -> run_result {
+  mpv_handle handle;
+  handle.script = std::move(script);
+  handle.script_opts = script_opts;
+  screensaver.reset();
+
+  int status = open_plugin(&handle);
+  return {status, screensaver.inhibits.load(), screensaver.uninhibits.load()};
+}
+
+void pause_flapping(plugin_entry open_plugin, mock_screensaver& screensaver) {
+  auto script = file_loaded(true);
+  for (std::size_t i = 0; i < events; ++i) {
+    script.push_back(pause_event(i % 2 != 0));
+  }
+
+  auto res = run(open_plugin, screensaver, std::move(script));
+  check(res.status == 0, __func__, "plugin returns 0");
+  check(res.inhibits == events / 2, __func__, "one Inhibit per unpause");
+  check(res.uninhibits == events / 2, __func__, "one UnInhibit per pause");
+}
+
+void repeated_pause_values(plugin_entry open_plugin,
+                           mock_screensaver& screensaver) {
+  auto script = file_loaded(true);
+  script.insert(script.end(), events, pause_event(false));
+  script.insert(script.end(), events, pause_event(true));
+
+  auto res = run(open_plugin, screensaver, std::move(script));
+  check(res.status == 0, __func__, "plugin returns 0");
+  check(res.inhibits == 1, __func__, "a single Inhibit");
+  check(res.uninhibits == 1, __func__, "a single UnInhibit");
+}
+
+void unrelated_event_flood(plugin_entry open_plugin,
+                           mock_screensaver& screensaver) {
+  constexpr std::array unrelated{
+      MPV_EVENT_PLAYBACK_RESTART, MPV_EVENT_VIDEO_RECONFIG,
+      MPV_EVENT_AUDIO_RECONFIG, MPV_EVENT_SEEK};
+
+  auto script = file_loaded(true);
+  script.push_back(pause_event(false));
+  for (std::size_t i = 0; i < events; ++i) {
+    script.push_back({unrelated[i % unrelated.size()]});
+  }
+  script.push_back(pause_event(true));
+
+  auto res = run(open_plugin, screensaver, std::move(script));
+  check(res.status == 0, __func__, "plugin returns 0");
+  check(res.inhibits == 1, __func__, "a single Inhibit");
+  check(res.uninhibits == 1, __func__, "a single UnInhibit");
+}
+
+void album_art(plugin_entry open_plugin, mock_screensaver& screensaver) {
+  // mpv selects embedded cover art as a video track.
+  auto script = file_loaded(true, true);
+  script.push_back(pause_event(false));
+  script.push_back(pause_event(true));
+
+  auto res = run(open_plugin, screensaver, script);
+  check(res.status == 0, __func__, "plugin returns 0");
+  check(res.inhibits == 0, __func__, "no Inhibit for cover art");
+
+  res = run(open_plugin, screensaver, std::move(script),
+            "inhibit-audio-only=yes");
+  check(res.inhibits == 1, __func__, "Inhibit with inhibit-audio-only");
+}
+
+auto property_event(const char* name, bool value) -> scripted_event {
+  return {MPV_EVENT_PROPERTY_CHANGE, name, value ? 1 : 0};
+}
+
+/**
+ * Play a file and interrupt playback once by setting `property`.
+ */
+auto interrupt(plugin_entry open_plugin,
+               mock_screensaver& screensaver,
+               const char* property,
+               const char* script_opts = "") -> run_result {
+  auto script = file_loaded(true);
+  script.push_back(pause_event(false));
+  script.push_back(property_event(property, true));
+  script.push_back(property_event(property, false));
+  script.push_back(pause_event(true));
+  return run(open_plugin, screensaver, std::move(script), script_opts);
+}
+
+void idle_and_eof(plugin_entry open_plugin, mock_screensaver& screensaver) {
+  for (const auto* property : {"idle-active", "eof-reached"}) {
+    auto res = interrupt(open_plugin, screensaver, property);
+    check(res.inhibits == 2 && res.uninhibits == 2, __func__, property);
+  }
+}
+
+void buffering(plugin_entry open_plugin, mock_screensaver& screensaver) {
+  auto res = interrupt(open_plugin, screensaver, "paused-for-cache");
+  check(res.inhibits == 2 && res.uninhibits == 2, __func__,
+        "UnInhibit while waiting for the cache");
+
+  res = interrupt(open_plugin, screensaver, "paused-for-cache",
+                  "inhibit-buffering=yes");
+  check(res.inhibits == 1 && res.uninhibits == 1, __func__,
+        "no UnInhibit with inhibit-buffering");
+}
+
+void minimized(plugin_entry open_plugin, mock_screensaver& screensaver) {
+  auto res = interrupt(open_plugin, screensaver, "window-minimized");
+  check(res.inhibits == 2 && res.uninhibits == 2, __func__,
+        "UnInhibit while minimized");
+
+  res = interrupt(open_plugin, screensaver, "window-minimized",
+                  "inhibit-minimized=yes");
+  check(res.inhibits == 1 && res.uninhibits == 1, __func__,
+        "no UnInhibit with inhibit-minimized");
+}
+
+void seeking(plugin_entry open_plugin, mock_screensaver& screensaver) {
+  // mpv sets core-idle while playback restarts after a seek.
+  auto script = file_loaded(true);
+  script.push_back(pause_event(false));
+  for (std::size_t i = 0; i < events; ++i) {
+    script.push_back(property_event("seeking", true));
+    script.push_back(property_event("core-idle", true));
+    script.push_back({MPV_EVENT_SEEK});
+    script.push_back({MPV_EVENT_PLAYBACK_RESTART});
+    script.push_back(property_event("core-idle", false));
+    script.push_back(property_event("seeking", false));
+  }
+  script.push_back(pause_event(true));
+
+  auto res = run(open_plugin, screensaver, std::move(script));
+  check(res.inhibits == 1 && res.uninhibits == 1, __func__,
+        "seeks issue no calls");
+}
+
+void script_opts(plugin_entry open_plugin, mock_screensaver& screensaver) {
+  // Unknown keys and entries without value are skipped.
+  const auto* opts =
+      "osc-visibility=always,inhibit-minimized=yes,garbage,"
+      "inhibit-buffering=true";
+  auto res = interrupt(open_plugin, screensaver, "window-minimized", opts);
+  check(res.uninhibits == 1, __func__, "inhibit-minimized=yes is read");
+  res = interrupt(open_plugin, screensaver, "paused-for-cache", opts);
+  check(res.uninhibits == 1, __func__, "inhibit-buffering=true is read");
+
+  // Invalid values keep the default.
+  res = interrupt(open_plugin, screensaver, "window-minimized",
+                  "inhibit-minimized=maybe");
+  check(res.uninhibits == 2, __func__, "invalid value keeps the default");
+
+  // Later entries override earlier ones.
+  res = interrupt(open_plugin, screensaver, "window-minimized",
+                  "inhibit-minimized=yes,inhibit-minimized=no");
+  check(res.uninhibits == 2, __func__, "last entry wins");
+}
+
+void shutdown_during_inhibit(plugin_entry open_plugin,
+                             mock_screensaver& screensaver) {
+  screensaver.set_reply_delay(std::chrono::milliseconds{50});
+
+  mpv_handle handle;
+  handle.script = file_loaded(true);
+  handle.script.push_back(pause_event(false));
+  // Never shut down through the script, only once Inhibit is in flight.
+  handle.script.insert(handle.script.end(), events,
+                       {MPV_EVENT_PLAYBACK_RESTART});
+  screensaver.reset();
+
+  std::atomic<bool> done{false};
+  std::thread shutdown_thread{[&handle, &screensaver, &done] {
+    while (!screensaver.in_call.load() && !done.load()) {
+      std::this_thread::yield();
+    }
+    handle.shutdown.store(true, std::memory_order_release);
+  }};
+
+  int status = open_plugin(&handle);
+  done.store(true);
+  shutdown_thread.join();
+  screensaver.set_reply_delay(std::chrono::microseconds{0});
+
+  check(status == 0, __func__, "plugin returns 0");
+  check(screensaver.inhibits.load() == 1, __func__, "Inhibit was answered");
+}
+
+void unmocked_call() {
+  // A call the mock does not implement must fail instead of blocking
+  // until the default timeout of 25 s, e.g. when the plugin starts
+  // making a new call.
+  auto conn = offlrofl::connection::session();
+  auto msg = offlrofl::message::method_call(
+      "org.freedesktop.ScreenSaver", "/org/freedesktop/ScreenSaver",
+      "org.freedesktop.ScreenSaver", "GetActive");
+
+  auto start = std::chrono::steady_clock::now();
+  check(test::throws([&] { conn.send_with_reply(msg); }), __func__,
+        "unmocked call fails");
+  check(std::chrono::steady_clock::now() - start < std::chrono::seconds{1},
+        __func__, "unmocked call fails fast");
+}
+}
+
+auto main() -> int {
+  try {
+    mock_screensaver screensaver;
+    auto open_plugin = mpv_shim::load_plugin(MPV_INHIBIT_PLUGIN);
+
+    pause_flapping(open_plugin, screensaver);
+    repeated_pause_values(open_plugin, screensaver);
+    unrelated_event_flood(open_plugin, screensaver);
+    album_art(open_plugin, screensaver);
+    idle_and_eof(open_plugin, screensaver);
+    buffering(open_plugin, screensaver);
+    minimized(open_plugin, screensaver);
+    seeking(open_plugin, screensaver);
+    script_opts(open_plugin, screensaver);
+    shutdown_during_inhibit(open_plugin, screensaver);
+    unmocked_call();
+
+    return test::exit_status();
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "Unknown error: {}\n", e.what());
+  }
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,194 @@
+#include <test.h>
+
+#include <offlrofl/message.h>
+#include <offlrofl/recorder.h>
+
+#include <fmt/format.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+extern "C" {
+#include <dbus/dbus.h>
+}
+
+// Checks the ring buffer of the recorder. Runs without a bus, the
+// recorded messages are only marshalled.
+
+using offlrofl::recorder;
+using test::check;
+using test::throws;
+
+namespace {
+auto make_call() -> offlrofl::message {
+  return offlrofl::message::method_call(
+      "org.freedesktop.ScreenSaver", "/org/freedesktop/ScreenSaver",
+      "org.freedesktop.ScreenSaver", "GetActive");
+}
+
+/**
+ * Return the number of bytes a record of the message occupies.
+ */
+auto record_length(DBusMessage* msg) -> std::size_t {
+  char* marshalled = nullptr;
+  int size = 0;
+  dbus_message_marshal(msg, &marshalled, &size);
+  dbus_free(marshalled);
+  auto length =
+      sizeof(recorder::record_header) + static_cast<std::size_t>(size);
+  return (length + 7U) & ~std::size_t{7U};
+}
+
+/**
+ * Return whether the records are calls with consecutive serials ending
+ * at `last`.
+ */
+auto newest_in_order(const std::vector<recorder::record>& records,
+                     uint32_t last) -> bool {
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    if (records[i].kind != recorder::record_kind::call ||
+        records[i].serial != last - (records.size() - 1 - i)) {
+      return false;
+    }
+    if (i > 0 && records[i].time.monotonic < records[i - 1].time.monotonic) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Write more records than fit into a ring leaving `remainder` bytes at
+ * the end of the data area unused and check that exactly the newest
+ * ones are read back.
+ */
+void wrap_around(const std::filesystem::path& file,
+                 std::size_t remainder,
+                 const char* test) {
+  constexpr uint32_t calls = 100;
+  constexpr std::size_t fitting = 10;
+
+  auto msg = make_call();
+  auto length = record_length(msg);
+  auto capacity = fitting * length + remainder;
+  {
+    recorder rec{file.string(), capacity};
+    for (uint32_t serial = 1; serial <= calls; ++serial) {
+      rec.append(recorder::record_kind::call, serial, recorder::now(), msg);
+    }
+  }
+
+  auto records = recorder::read(file.string());
+  check(newest_in_order(records, calls), test,
+        "the newest records are read in order");
+  // Records are only dropped to make room, the space at the end of the
+  // data area may hold at most one more record.
+  check(records.size() + 2 > capacity / length && records.size() <= fitting,
+        test, "no records are dropped needlessly");
+
+  // Reopening keeps the records.
+  {
+    recorder rec{file.string(), capacity};
+    rec.append(recorder::record_kind::call, calls + 1, recorder::now(), msg);
+  }
+  records = recorder::read(file.string());
+  check(newest_in_order(records, calls + 1), test,
+        "records are appended after reopening");
+}
+
+void padding_record(const std::filesystem::path& dir) {
+  // Enough space at the end for a padding record.
+  wrap_around(dir / "padding.rec", sizeof(recorder::record_header) + 8,
+              __func__);
+}
+
+void skipped_end(const std::filesystem::path& dir) {
+  // Too little space at the end for a record header.
+  wrap_around(dir / "skipped.rec", 16, __func__);
+}
+
+void corrupt_length(const std::filesystem::path& dir) {
+  auto file = dir / "corrupt.rec";
+  auto msg = make_call();
+  auto capacity = 10 * record_length(msg);
+  {
+    recorder rec{file.string(), capacity};
+    for (uint32_t serial = 1; serial <= 5; ++serial) {
+      rec.append(recorder::record_kind::call, serial, recorder::now(), msg);
+    }
+  }
+
+  // Claim the oldest record extends past the end of the data area.
+  {
+    std::fstream out{file, std::ios::in | std::ios::out | std::ios::binary};
+    uint32_t size = 0xffffffffU;
+    out.seekp(recorder::data_offset);
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  }
+  check(throws([&] { recorder::read(file.string()); }), __func__,
+        "corrupt length is rejected on reading");
+
+  // Making room drops the corrupt records instead of trusting them.
+  {
+    recorder rec{file.string(), capacity};
+    for (uint32_t serial = 6; serial <= 30; ++serial) {
+      rec.append(recorder::record_kind::call, serial, recorder::now(), msg);
+    }
+  }
+  std::vector<recorder::record> records;
+  check(!throws([&] { records = recorder::read(file.string()); }), __func__,
+        "corrupt records are dropped on writing");
+  check(!records.empty() && newest_in_order(records, 30), __func__,
+        "the newest records survive");
+}
+
+void foreign_file(const std::filesystem::path& dir) {
+  auto file = dir / "foreign.txt";
+  const std::string content = "not a recording\n";
+  std::ofstream{file} << content;
+
+  check(throws([&] { recorder rec{file.string(), 4096}; }), __func__,
+        "other files are not opened");
+
+  std::ifstream in{file};
+  std::string read_back{std::istreambuf_iterator<char>{in},
+                        std::istreambuf_iterator<char>{}};
+  check(read_back == content, __func__, "other files are left alone");
+}
+
+void single_writer(const std::filesystem::path& dir) {
+  auto file = dir / "locked.rec";
+  recorder rec{file.string(), 4096};
+  check(throws([&] { recorder second{file.string(), 4096}; }), __func__,
+        "a recording is only opened once");
+}
+}
+
+auto main() -> int {
+  try {
+    auto dir = std::filesystem::temp_directory_path() /
+               fmt::format("offlrofl-recorder-{}", getpid());
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    padding_record(dir);
+    skipped_end(dir);
+    corrupt_length(dir);
+    foreign_file(dir);
+    single_writer(dir);
+    std::filesystem::remove_all(dir);
+
+    return test::exit_status();
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "Unknown error: {}\n", e.what());
+  }
+  return EXIT_FAILURE;
+}
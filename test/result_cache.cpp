@@ -0,0 +1,286 @@
+#include <mock_service.h>
+#include <test.h>
+
+#include <offlrofl/connection.h>
+#include <offlrofl/message.h>
+#include <offlrofl/result_cache.h>
+
+#include <result_cache_interface.h>
+
+#include <fmt/format.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+extern "C" {
+#include <dbus/dbus.h>
+}
+
+// Checks result_cache and the proxies generated from
+// test/result_cache.xml with test/result_cache.conf against a mock
+// service. Must be run on a bus of its own, the test target runs it
+// under dbus-run-session.
+
+using offlrofl::result_cache;
+using test::check;
+
+namespace {
+constexpr auto service = "org.offlrofl.Test";
+constexpr auto iface = "org.offlrofl.Test";
+
+constexpr std::chrono::milliseconds short_ttl{50};
+
+// Long enough for entries with short_ttl to expire.
+void wait_for_expiry() { std::this_thread::sleep_for(short_ttl * 2); }
+
+/**
+ * Test service implementing the interfaces of test/result_cache.xml.
+ * Counts the calls it answered.
+ */
+class test_service {
+public:
+  test_service()
+      : service_impl{service, [this](auto* msg) { return answer(msg); }} {}
+
+  [[nodiscard]] auto get_unique_name() const -> const std::string& {
+    return service_impl.get_unique_name();
+  }
+
+  std::atomic<bool> active{true};
+  std::atomic<uint64_t> calls{0};
+
+private:
+  auto answer(DBusMessage* msg) -> DBusMessage* {
+    ++calls;
+    if (dbus_message_is_method_call(msg, iface, "GetActive") != FALSE) {
+      dbus_bool_t value = active.load() ? TRUE : FALSE;
+      auto* reply = dbus_message_new_method_return(msg);
+      dbus_message_append_args(reply, DBUS_TYPE_BOOLEAN, &value,
+                               DBUS_TYPE_INVALID);
+      return reply;
+    }
+
+    if (dbus_message_is_method_call(msg, iface, "Square") != FALSE) {
+      int32_t value = 0;
+      dbus_message_get_args(msg, nullptr, DBUS_TYPE_INT32, &value,
+                            DBUS_TYPE_INVALID);
+      int32_t square = value * value;
+      auto* reply = dbus_message_new_method_return(msg);
+      dbus_message_append_args(reply, DBUS_TYPE_INT32, &square,
+                               DBUS_TYPE_INVALID);
+      return reply;
+    }
+
+    if (dbus_message_is_method_call(msg, iface, "Echo") != FALSE) {
+      const char* text = "";
+      dbus_message_get_args(msg, nullptr, DBUS_TYPE_STRING, &text,
+                            DBUS_TYPE_INVALID);
+      auto* reply = dbus_message_new_method_return(msg);
+      dbus_message_append_args(reply, DBUS_TYPE_STRING, &text,
+                               DBUS_TYPE_INVALID);
+      return reply;
+    }
+
+    // Both interfaces have Not.
+    if (dbus_message_has_member(msg, "Not") != FALSE) {
+      dbus_bool_t value = FALSE;
+      dbus_message_get_args(msg, nullptr, DBUS_TYPE_BOOLEAN, &value,
+                            DBUS_TYPE_INVALID);
+      dbus_bool_t negated = value != FALSE ? FALSE : TRUE;
+      auto* reply = dbus_message_new_method_return(msg);
+      dbus_message_append_args(reply, DBUS_TYPE_BOOLEAN, &negated,
+                               DBUS_TYPE_INVALID);
+      return reply;
+    }
+
+    if (dbus_message_is_method_call(msg, iface, "Reset") != FALSE) {
+      return dbus_message_new_method_return(msg);
+    }
+
+    return nullptr;
+  }
+
+  mock_service service_impl;
+};
+
+template <typename Proxy, typename = void>
+struct has_cache_stats : std::false_type {};
+
+template <typename Proxy>
+struct has_cache_stats<
+    Proxy,
+    std::void_t<decltype(std::declval<Proxy>().get_cache_stats())>>
+    : std::true_type {};
+
+// Only interfaces with cacheable methods carry a cache.
+static_assert(has_cache_stats<org_offlrofl_Test>::value);
+static_assert(!has_cache_stats<org_offlrofl_Plain>::value);
+
+auto same_stats(const result_cache::stats& stats,
+                uint64_t hits,
+                uint64_t misses,
+                uint64_t invalidations) -> bool {
+  return stats.hits == hits && stats.misses == misses &&
+         stats.invalidations == invalidations;
+}
+
+/**
+ * Wait until the bus delivered everything it sent to the shared session
+ * connection before, e.g. NameOwnerChanged signals of a restart, by
+ * asking it for the owner of the service.
+ */
+auto current_owner(offlrofl::connection& conn) -> std::string {
+  auto msg = offlrofl::message::method_call(
+      DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS, "GetNameOwner",
+      service);
+  return conn.send_with_reply(msg).get_argument<const char*>();
+}
+
+void argument_keys() {
+  auto conn = offlrofl::connection::session();
+  result_cache cache;
+
+  check(result_cache::make_key("M", int32_t{1}) !=
+            result_cache::make_key("M", int32_t{2}),
+        __func__, "arguments are part of the key");
+  check(result_cache::make_key("M", "a", "b") !=
+            result_cache::make_key("M", "ab"),
+        __func__, "arguments are separated");
+  check(result_cache::make_key("M") != result_cache::make_key("N"), __func__,
+        "method is part of the key");
+
+  cache.put(result_cache::make_key("Square", int32_t{2}), int32_t{4},
+            std::chrono::minutes{1});
+  cache.put(result_cache::make_key("Square", int32_t{3}), int32_t{9},
+            std::chrono::minutes{1});
+  check(cache.get<int32_t>(conn, service,
+                           result_cache::make_key("Square", int32_t{2})) == 4,
+        __func__, "first tuple keeps its result");
+  check(cache.get<int32_t>(conn, service,
+                           result_cache::make_key("Square", int32_t{3})) == 9,
+        __func__, "second tuple keeps its result");
+  check(!cache.get<int32_t>(conn, service,
+                            result_cache::make_key("Square", int32_t{4})),
+        __func__, "other tuples are not cached");
+  check(same_stats(cache.get_stats(), 2, 1, 0), __func__,
+        "hits and misses are counted");
+}
+
+void ttl_expiry() {
+  auto conn = offlrofl::connection::session();
+  result_cache cache;
+  auto key = result_cache::make_key("GetActive");
+
+  cache.put(key, true, short_ttl);
+  check(cache.get<bool>(conn, service, key) == true, __func__,
+        "result is cached");
+  wait_for_expiry();
+  check(!cache.get<bool>(conn, service, key), __func__,
+        "result expires");
+  check(same_stats(cache.get_stats(), 1, 1, 0), __func__,
+        "expired result is a miss");
+}
+
+void pruning() {
+  auto conn = offlrofl::connection::session();
+  result_cache cache;
+
+  for (int32_t i = 0; i < 10; ++i) {
+    cache.put(result_cache::make_key("Square", i), i * i, short_ttl);
+  }
+  cache.put(result_cache::make_key("GetActive"), true,
+            std::chrono::minutes{1});
+  wait_for_expiry();
+  cache.put(result_cache::make_key("Square", int32_t{10}), int32_t{100},
+            short_ttl);
+  check(cache.size() == 2, __func__,
+        "put drops results never looked up again");
+
+  wait_for_expiry();
+  check(!cache.get<std::string>(conn, service,
+                                result_cache::make_key("Echo", "text")),
+        __func__, "other results are not cached");
+  check(cache.size() == 1, __func__, "find drops expired results");
+}
+
+void generated_proxy() {
+  test_service svc;
+  org_offlrofl_Test proxy;
+
+  check(proxy.GetActive(), __func__, "true is returned");
+  svc.active = false;
+  check(proxy.GetActive(), __func__, "configured method is cached");
+  check(svc.calls.load() == 1, __func__, "cached method is called once");
+
+  check(proxy.Square(2) == 4 && proxy.Square(3) == 9 && proxy.Square(2) == 4,
+        __func__, "annotated method returns the square");
+  check(svc.calls.load() == 3, __func__,
+        "annotated method is cached per argument");
+
+  check(proxy.Echo("text") == "text" && proxy.Echo("text") == "text",
+        __func__, "strings are cached");
+  check(svc.calls.load() == 4, __func__, "configured method is cached");
+  wait_for_expiry();
+  check(proxy.Echo("text") == "text", __func__, "expired string");
+  check(svc.calls.load() == 5, __func__,
+        "configuration overrides the annotation");
+
+  check(!proxy.Not(true) && proxy.Not(false) && !proxy.Not(true), __func__,
+        "booleans are passed both ways");
+  proxy.Reset();
+  proxy.Reset();
+  check(svc.calls.load() == 10, __func__, "other methods are not cached");
+
+  check(same_stats(proxy.get_cache_stats(), 3, 5, 0), __func__,
+        "hits and misses of the proxy");
+
+  org_offlrofl_Plain plain{service, "/org/offlrofl/Test"};
+  check(plain.Not(false), __func__, "proxy without cache works");
+}
+
+void owner_change() {
+  auto conn = offlrofl::connection::session();
+  std::optional<test_service> svc;
+  svc.emplace();
+  org_offlrofl_Test proxy;
+
+  check(proxy.Square(2) == 4 && proxy.Square(2) == 4, __func__,
+        "result is cached");
+
+  // Restart the service.
+  svc.reset();
+  svc.emplace();
+  check(current_owner(conn) == svc->get_unique_name(), __func__,
+        "service restarted");
+
+  check(proxy.Square(2) == 4 && proxy.Square(2) == 4, __func__,
+        "result is cached again");
+  check(svc->calls.load() == 1, __func__,
+        "restarted service is called once");
+  check(same_stats(proxy.get_cache_stats(), 2, 2, 1), __func__,
+        "restart invalidates the cache once");
+}
+}
+
+auto main() -> int {
+  try {
+    argument_keys();
+    ttl_expiry();
+    pruning();
+    generated_proxy();
+    owner_change();
+
+    return test::exit_status();
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "Unknown error: {}\n", e.what());
+  }
+  return EXIT_FAILURE;
+}
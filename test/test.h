@@ -0,0 +1,42 @@
+#pragma once
+
+#include <fmt/format.h>
+
+#include <cstdlib>
+#include <exception>
+
+namespace test {
+// Number of failed checks of the test executable.
+inline int failures = 0;
+
+/**
+ * Report a failed check. The test goes on, so a single run reports all
+ * failures.
+ */
+inline void check(bool condition, const char* test, const char* what) {
+  if (!condition) {
+    fmt::print(stderr, "{}: check failed: {}\n", test, what);
+    ++failures;
+  }
+}
+
+/**
+ * Return whether calling `fn` throws.
+ */
+template <typename Fn>
+auto throws(Fn&& fn) -> bool {
+  try {
+    fn();
+  } catch (const std::exception&) {
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Return the exit status of the test executable.
+ */
+inline auto exit_status() -> int {
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+}